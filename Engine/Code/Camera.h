@@ -19,6 +19,8 @@ const float PITCH = 0.0f;
 const float SPEED = 5.0f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 1000.0f;
 
 
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
@@ -74,7 +76,7 @@ public:
 
     void CalculateProjection(float diplayX, float displayY)
     {
-        projection = glm::perspective(glm::radians(45.0f), diplayX / displayY, 0.1f, 1000.0f);
+        projection = glm::perspective(glm::radians(45.0f), diplayX / displayY, NEAR_PLANE, FAR_PLANE);
     }
 
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
@@ -14,4 +14,28 @@ struct Light
 	glm::vec3 color;
 	glm::vec3 direction;
 	glm::vec3 position;
-};
\ No newline at end of file
+};
+
+// Light as laid out in the std430 light buffer of the clustered pass (48 bytes)
+struct GpuLight
+{
+	glm::vec3 color;
+	u32 type;
+	glm::vec3 direction;
+	f32 radius;
+	glm::vec3 position;
+	f32 padding;
+};
+
+// The forward shaders and the full screen deferred pass read the lights from a fixed
+// size array in GlobalParams, the clustered pass reads them from a storage buffer
+#define MAX_FORWARD_LIGHTS 16
+#define MAX_CLUSTERED_LIGHTS 4096
+
+// Froxel grid of the clustered pass, must match clusterlights.glsl. Depth
+// slices are exponential between the camera near and far planes.
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_MAX_LIGHT_INDICES (CLUSTER_COUNT * 64)
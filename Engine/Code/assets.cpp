@@ -0,0 +1,68 @@
+#include "assets.h"
+
+AssetKey MakeAssetKey(AssetType type, const char* path)
+{
+    // "./dir\file" and "dir/file" are the same asset
+    if (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+        path += 2;
+
+    u64 hash = HashBytes(&type, sizeof(type));
+    for (const char* c = path; *c; ++c)
+    {
+        const char normalized = *c == '\\' ? '/' : *c;
+        hash = HashBytes(&normalized, 1, hash);
+    }
+    return hash;
+}
+
+AssetKey MakeContentAssetKey(AssetType type, u64 contentHash)
+{
+    return HashBytes(&contentHash, sizeof(contentHash), HashBytes(&type, sizeof(type)));
+}
+
+u32 AcquireAsset(AssetRegistry& registry, AssetKey key)
+{
+    std::unordered_map<AssetKey, AssetEntry>::iterator it = registry.entries.find(key);
+    if (it == registry.entries.end())
+        return UINT32_MAX;
+
+    it->second.refCount++;
+    return it->second.index;
+}
+
+u32 FindAsset(const AssetRegistry& registry, AssetKey key)
+{
+    std::unordered_map<AssetKey, AssetEntry>::const_iterator it = registry.entries.find(key);
+    return it == registry.entries.end() ? UINT32_MAX : it->second.index;
+}
+
+void RegisterAsset(AssetRegistry& registry, AssetKey key, AssetType type, u32 index, const char* name)
+{
+    ASSERT(registry.entries.find(key) == registry.entries.end(), "Asset registered twice");
+
+    AssetEntry entry = {};
+    entry.type = type;
+    entry.index = index;
+    entry.refCount = 1;
+    entry.name = name;
+    registry.entries[key] = entry;
+    registry.counts[type]++;
+}
+
+u32 ReleaseAsset(AssetRegistry& registry, AssetKey key)
+{
+    std::unordered_map<AssetKey, AssetEntry>::iterator it = registry.entries.find(key);
+    if (it == registry.entries.end())
+    {
+        ELOG("Releasing an asset that is not registered");
+        return UINT32_MAX;
+    }
+
+    const u32 refCount = --it->second.refCount;
+    if (refCount == 0)
+    {
+        registry.counts[it->second.type]--;
+        registry.entries.erase(it);
+    }
+    return refCount;
+}
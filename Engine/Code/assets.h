@@ -0,0 +1,49 @@
+#pragma once
+
+#include "platform.h"
+#include <unordered_map>
+
+enum AssetType
+{
+	AssetType_Texture,
+	AssetType_Model,
+	AssetType_Mesh,
+	AssetType_Count
+};
+
+// Textures and models are keyed by their type and normalized path, meshes by the hash of
+// the source file contents so identical files share their buffers
+typedef u64 AssetKey;
+
+struct AssetEntry
+{
+	AssetType type;
+	u32 index; // in the App array of its type
+	u32 refCount;
+	std::string name;
+};
+
+struct AssetRegistry
+{
+	std::unordered_map<AssetKey, AssetEntry> entries;
+	u32 counts[AssetType_Count];
+};
+
+AssetKey MakeAssetKey(AssetType type, const char* path);
+
+AssetKey MakeContentAssetKey(AssetType type, u64 contentHash);
+
+// Returns the index of a registered asset and adds a reference to it, or UINT32_MAX
+u32 AcquireAsset(AssetRegistry& registry, AssetKey key);
+
+// Returns the index of a registered asset without adding a reference, or UINT32_MAX
+u32 FindAsset(const AssetRegistry& registry, AssetKey key);
+
+// Adds an asset with a single reference
+void RegisterAsset(AssetRegistry& registry, AssetKey key, AssetType type, u32 index, const char* name);
+
+/**
+ * Drops a reference and returns how many are left. The entry is removed when none are,
+ * the caller then frees the asset. Returns UINT32_MAX if the key is not registered.
+ */
+u32 ReleaseAsset(AssetRegistry& registry, AssetKey key);
@@ -8,4 +8,35 @@ public:
     GLuint handle;
     u8* data;
     u32 head;
-};
\ No newline at end of file
+};
+
+#define RING_BUFFER_MAX_REGIONS 4
+#define RING_BUFFER_FRAME_COUNT 3
+
+// A buffer split in regionCount regions of regionSize bytes that is written one region
+// per frame. It stays mapped for its whole life when glBufferStorage is available and
+// each region is protected with a fence, so the CPU only waits if it laps the GPU.
+// head is an absolute offset in the whole buffer, so it can be fed to glBindBufferRange.
+class RingBuffer : public Buffer
+{
+public:
+    u32 regionSize;
+    u32 regionCount;
+    u32 regionIdx;
+    bool persistent;
+    GLsync fences[RING_BUFFER_MAX_REGIONS];
+
+    u32 stallCount;
+};
+
+// A constant buffer made of a chain of ring buffer pages. A block that doesn't fit in
+// what is left of the current page goes to the next one, which is created on demand,
+// so the amount of data pushed per frame isn't capped by a single buffer size.
+class PagedBuffer
+{
+public:
+    std::vector<RingBuffer> pages;
+    u32 pageSize;
+    u32 pageIdx;
+    GLenum type;
+};
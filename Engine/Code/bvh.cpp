@@ -0,0 +1,554 @@
+#include "bvh.h"
+
+#include <float.h>
+#include <chrono>
+#include <random>
+
+static f32 AabbSurfaceArea(const Aabb& aabb)
+{
+    const glm::vec3 d = aabb.max - aabb.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static Aabb CombineAabbs(const Aabb& a, const Aabb& b)
+{
+    Aabb aabb;
+    aabb.min = glm::min(a.min, b.min);
+    aabb.max = glm::max(a.max, b.max);
+    return aabb;
+}
+
+static bool AabbContains(const Aabb& outer, const Aabb& inner)
+{
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) &&
+           glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+static bool AabbOverlapsSphere(const Aabb& aabb, const glm::vec3& center, f32 radius)
+{
+    const glm::vec3 closest = glm::clamp(center, aabb.min, aabb.max);
+    const glm::vec3 d = closest - center;
+    return glm::dot(d, d) <= radius * radius;
+}
+
+static bool IsAabbInsideFrustum(const Frustum& frustum, const Aabb& aabb)
+{
+    for (u32 i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // The corner furthest against the plane normal
+        const glm::vec3 corner(
+            plane.x >= 0.0f ? aabb.min.x : aabb.max.x,
+            plane.y >= 0.0f ? aabb.min.y : aabb.max.y,
+            plane.z >= 0.0f ? aabb.min.z : aabb.max.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+static u32 AllocateNode(Bvh& bvh)
+{
+    if (bvh.freeList == BVH_NULL_NODE)
+    {
+        const u32 oldCount = (u32)bvh.nodes.size();
+        const u32 newCount = oldCount == 0 ? 16 : oldCount * 2;
+        bvh.nodes.resize(newCount);
+        for (u32 i = oldCount; i < newCount; ++i)
+        {
+            bvh.nodes[i].parent = i + 1 < newCount ? i + 1 : BVH_NULL_NODE;
+            bvh.nodes[i].height = -1;
+        }
+        bvh.freeList = oldCount;
+    }
+
+    const u32 nodeIdx = bvh.freeList;
+    BvhNode& node = bvh.nodes[nodeIdx];
+    bvh.freeList = node.parent;
+    node.parent = BVH_NULL_NODE;
+    node.child1 = BVH_NULL_NODE;
+    node.child2 = BVH_NULL_NODE;
+    node.height = 0;
+    node.userData = BVH_NULL_NODE;
+    return nodeIdx;
+}
+
+static void FreeNode(Bvh& bvh, u32 nodeIdx)
+{
+    bvh.nodes[nodeIdx].parent = bvh.freeList;
+    bvh.nodes[nodeIdx].height = -1;
+    bvh.freeList = nodeIdx;
+}
+
+// Rotates the subtree at a up if one of its children is more than one level taller than
+// the other. Returns the new root of the subtree.
+static u32 Balance(Bvh& bvh, u32 aIdx)
+{
+    BvhNode* nodes = bvh.nodes.data();
+    BvhNode& a = nodes[aIdx];
+    if (a.child1 == BVH_NULL_NODE || a.height < 2)
+        return aIdx;
+
+    const u32 bIdx = a.child1;
+    const u32 cIdx = a.child2;
+    BvhNode& b = nodes[bIdx];
+    BvhNode& c = nodes[cIdx];
+    const i32 balance = c.height - b.height;
+
+    // Rotate c up
+    if (balance > 1)
+    {
+        const u32 fIdx = c.child1;
+        const u32 gIdx = c.child2;
+        BvhNode& f = nodes[fIdx];
+        BvhNode& g = nodes[gIdx];
+
+        c.child1 = aIdx;
+        c.parent = a.parent;
+        a.parent = cIdx;
+
+        if (c.parent != BVH_NULL_NODE)
+        {
+            if (nodes[c.parent].child1 == aIdx) nodes[c.parent].child1 = cIdx;
+            else                                nodes[c.parent].child2 = cIdx;
+        }
+        else
+        {
+            bvh.root = cIdx;
+        }
+
+        if (f.height > g.height)
+        {
+            c.child2 = fIdx;
+            a.child2 = gIdx;
+            g.parent = aIdx;
+            a.aabb = CombineAabbs(b.aabb, g.aabb);
+            c.aabb = CombineAabbs(a.aabb, f.aabb);
+            a.height = 1 + glm::max(b.height, g.height);
+            c.height = 1 + glm::max(a.height, f.height);
+        }
+        else
+        {
+            c.child2 = gIdx;
+            a.child2 = fIdx;
+            f.parent = aIdx;
+            a.aabb = CombineAabbs(b.aabb, f.aabb);
+            c.aabb = CombineAabbs(a.aabb, g.aabb);
+            a.height = 1 + glm::max(b.height, f.height);
+            c.height = 1 + glm::max(a.height, g.height);
+        }
+
+        return cIdx;
+    }
+
+    // Rotate b up
+    if (balance < -1)
+    {
+        const u32 dIdx = b.child1;
+        const u32 eIdx = b.child2;
+        BvhNode& d = nodes[dIdx];
+        BvhNode& e = nodes[eIdx];
+
+        b.child1 = aIdx;
+        b.parent = a.parent;
+        a.parent = bIdx;
+
+        if (b.parent != BVH_NULL_NODE)
+        {
+            if (nodes[b.parent].child1 == aIdx) nodes[b.parent].child1 = bIdx;
+            else                                nodes[b.parent].child2 = bIdx;
+        }
+        else
+        {
+            bvh.root = bIdx;
+        }
+
+        if (d.height > e.height)
+        {
+            b.child2 = dIdx;
+            a.child1 = eIdx;
+            e.parent = aIdx;
+            a.aabb = CombineAabbs(c.aabb, e.aabb);
+            b.aabb = CombineAabbs(a.aabb, d.aabb);
+            a.height = 1 + glm::max(c.height, e.height);
+            b.height = 1 + glm::max(a.height, d.height);
+        }
+        else
+        {
+            b.child2 = eIdx;
+            a.child1 = dIdx;
+            d.parent = aIdx;
+            a.aabb = CombineAabbs(c.aabb, d.aabb);
+            b.aabb = CombineAabbs(a.aabb, e.aabb);
+            a.height = 1 + glm::max(c.height, d.height);
+            b.height = 1 + glm::max(a.height, e.height);
+        }
+
+        return bIdx;
+    }
+
+    return aIdx;
+}
+
+// Walks from a node up to the root, fixing heights and boxes and rebalancing on the way
+static void RefitAncestors(Bvh& bvh, u32 nodeIdx)
+{
+    while (nodeIdx != BVH_NULL_NODE)
+    {
+        nodeIdx = Balance(bvh, nodeIdx);
+
+        BvhNode& node = bvh.nodes[nodeIdx];
+        const BvhNode& child1 = bvh.nodes[node.child1];
+        const BvhNode& child2 = bvh.nodes[node.child2];
+        node.height = 1 + glm::max(child1.height, child2.height);
+        node.aabb = CombineAabbs(child1.aabb, child2.aabb);
+
+        nodeIdx = node.parent;
+    }
+}
+
+static void InsertLeaf(Bvh& bvh, u32 leafIdx)
+{
+    if (bvh.root == BVH_NULL_NODE)
+    {
+        bvh.root = leafIdx;
+        bvh.nodes[leafIdx].parent = BVH_NULL_NODE;
+        return;
+    }
+
+    // Descend to the sibling that makes the tree cheapest (surface area heuristic)
+    const Aabb leafAabb = bvh.nodes[leafIdx].aabb;
+    u32 siblingIdx = bvh.root;
+    while (bvh.nodes[siblingIdx].child1 != BVH_NULL_NODE)
+    {
+        const BvhNode& node = bvh.nodes[siblingIdx];
+        const f32 area = AabbSurfaceArea(node.aabb);
+        const f32 combinedArea = AabbSurfaceArea(CombineAabbs(node.aabb, leafAabb));
+
+        // Cost of making a new parent for this node and the leaf
+        const f32 cost = 2.0f * combinedArea;
+
+        // Minimum cost of pushing the leaf further down the tree
+        const f32 inheritanceCost = 2.0f * (combinedArea - area);
+
+        f32 childCosts[2];
+        const u32 children[2] = { node.child1, node.child2 };
+        for (u32 i = 0; i < 2; ++i)
+        {
+            const BvhNode& child = bvh.nodes[children[i]];
+            const f32 childArea = AabbSurfaceArea(CombineAabbs(child.aabb, leafAabb));
+            childCosts[i] = child.child1 == BVH_NULL_NODE ?
+                childArea + inheritanceCost :
+                childArea - AabbSurfaceArea(child.aabb) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1])
+            break;
+
+        siblingIdx = childCosts[0] < childCosts[1] ? children[0] : children[1];
+    }
+
+    const u32 oldParentIdx = bvh.nodes[siblingIdx].parent;
+    const u32 newParentIdx = AllocateNode(bvh);
+
+    BvhNode& newParent = bvh.nodes[newParentIdx];
+    newParent.parent = oldParentIdx;
+    newParent.aabb = CombineAabbs(leafAabb, bvh.nodes[siblingIdx].aabb);
+    newParent.height = bvh.nodes[siblingIdx].height + 1;
+    newParent.child1 = siblingIdx;
+    newParent.child2 = leafIdx;
+
+    if (oldParentIdx != BVH_NULL_NODE)
+    {
+        if (bvh.nodes[oldParentIdx].child1 == siblingIdx) bvh.nodes[oldParentIdx].child1 = newParentIdx;
+        else                                              bvh.nodes[oldParentIdx].child2 = newParentIdx;
+    }
+    else
+    {
+        bvh.root = newParentIdx;
+    }
+    bvh.nodes[siblingIdx].parent = newParentIdx;
+    bvh.nodes[leafIdx].parent = newParentIdx;
+
+    RefitAncestors(bvh, newParentIdx);
+}
+
+static void RemoveLeaf(Bvh& bvh, u32 leafIdx)
+{
+    if (leafIdx == bvh.root)
+    {
+        bvh.root = BVH_NULL_NODE;
+        return;
+    }
+
+    const u32 parentIdx = bvh.nodes[leafIdx].parent;
+    const u32 grandParentIdx = bvh.nodes[parentIdx].parent;
+    const u32 siblingIdx = bvh.nodes[parentIdx].child1 == leafIdx ?
+        bvh.nodes[parentIdx].child2 :
+        bvh.nodes[parentIdx].child1;
+
+    // The sibling takes the place of the parent
+    if (grandParentIdx != BVH_NULL_NODE)
+    {
+        if (bvh.nodes[grandParentIdx].child1 == parentIdx) bvh.nodes[grandParentIdx].child1 = siblingIdx;
+        else                                               bvh.nodes[grandParentIdx].child2 = siblingIdx;
+        bvh.nodes[siblingIdx].parent = grandParentIdx;
+        FreeNode(bvh, parentIdx);
+        RefitAncestors(bvh, grandParentIdx);
+    }
+    else
+    {
+        bvh.root = siblingIdx;
+        bvh.nodes[siblingIdx].parent = BVH_NULL_NODE;
+        FreeNode(bvh, parentIdx);
+    }
+}
+
+void InitBvh(Bvh& bvh, f32 margin)
+{
+    bvh.nodes.clear();
+    bvh.root = BVH_NULL_NODE;
+    bvh.freeList = BVH_NULL_NODE;
+    bvh.proxyCount = 0;
+    bvh.margin = margin;
+}
+
+u32 BvhInsert(Bvh& bvh, const Aabb& aabb, u32 userData)
+{
+    const u32 leafIdx = AllocateNode(bvh);
+    BvhNode& leaf = bvh.nodes[leafIdx];
+    leaf.aabb.min = aabb.min - glm::vec3(bvh.margin);
+    leaf.aabb.max = aabb.max + glm::vec3(bvh.margin);
+    leaf.userData = userData;
+    leaf.height = 0;
+
+    InsertLeaf(bvh, leafIdx);
+    bvh.proxyCount++;
+    return leafIdx;
+}
+
+void BvhRemove(Bvh& bvh, u32 proxy)
+{
+    ASSERT(proxy < bvh.nodes.size() && bvh.nodes[proxy].height == 0, "Invalid BVH proxy");
+    RemoveLeaf(bvh, proxy);
+    FreeNode(bvh, proxy);
+    bvh.proxyCount--;
+}
+
+bool BvhMove(Bvh& bvh, u32 proxy, const Aabb& aabb)
+{
+    ASSERT(proxy < bvh.nodes.size() && bvh.nodes[proxy].height == 0, "Invalid BVH proxy");
+    if (AabbContains(bvh.nodes[proxy].aabb, aabb))
+        return false;
+
+    RemoveLeaf(bvh, proxy);
+    bvh.nodes[proxy].aabb.min = aabb.min - glm::vec3(bvh.margin);
+    bvh.nodes[proxy].aabb.max = aabb.max + glm::vec3(bvh.margin);
+    InsertLeaf(bvh, proxy);
+    return true;
+}
+
+// Adds every leaf under a node without testing it
+static void GatherLeaves(Bvh& bvh, u32 nodeIdx, std::vector<u32>& results)
+{
+    const size_t stackBase = bvh.stack.size();
+    bvh.stack.push_back(nodeIdx);
+    while (bvh.stack.size() > stackBase)
+    {
+        const BvhNode& node = bvh.nodes[bvh.stack.back()];
+        bvh.stack.pop_back();
+        if (node.child1 == BVH_NULL_NODE)
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            bvh.stack.push_back(node.child1);
+            bvh.stack.push_back(node.child2);
+        }
+    }
+}
+
+void BvhQueryFrustum(Bvh& bvh, const Frustum& frustum, std::vector<u32>& results)
+{
+    if (bvh.root == BVH_NULL_NODE)
+        return;
+
+    bvh.stack.clear();
+    bvh.stack.push_back(bvh.root);
+    while (!bvh.stack.empty())
+    {
+        const u32 nodeIdx = bvh.stack.back();
+        bvh.stack.pop_back();
+
+        const BvhNode& node = bvh.nodes[nodeIdx];
+        if (!IsAabbVisible(frustum, node.aabb))
+            continue;
+
+        if (node.child1 == BVH_NULL_NODE)
+        {
+            results.push_back(node.userData);
+        }
+        else if (IsAabbInsideFrustum(frustum, node.aabb))
+        {
+            GatherLeaves(bvh, nodeIdx, results);
+        }
+        else
+        {
+            bvh.stack.push_back(node.child1);
+            bvh.stack.push_back(node.child2);
+        }
+    }
+}
+
+void BvhQuerySphere(Bvh& bvh, const glm::vec3& center, f32 radius, std::vector<u32>& results)
+{
+    if (bvh.root == BVH_NULL_NODE)
+        return;
+
+    bvh.stack.clear();
+    bvh.stack.push_back(bvh.root);
+    while (!bvh.stack.empty())
+    {
+        const BvhNode& node = bvh.nodes[bvh.stack.back()];
+        bvh.stack.pop_back();
+
+        if (!AabbOverlapsSphere(node.aabb, center, radius))
+            continue;
+
+        if (node.child1 == BVH_NULL_NODE)
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            bvh.stack.push_back(node.child1);
+            bvh.stack.push_back(node.child2);
+        }
+    }
+}
+
+f32 RayAabbDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const Aabb& aabb)
+{
+    const glm::vec3 t0 = (aabb.min - origin) * inverseDirection;
+    const glm::vec3 t1 = (aabb.max - origin) * inverseDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    const f32 entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    const f32 exit = glm::min(glm::min(tFar.x, tFar.y), tFar.z);
+    return entry <= exit ? entry : -1.0f;
+}
+
+u32 BvhRaycast(Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, BvhRayCallback callback, void* context, f32& hitDistance)
+{
+    u32 hitUserData = BVH_NULL_NODE;
+    hitDistance = FLT_MAX;
+    if (bvh.root == BVH_NULL_NODE)
+        return hitUserData;
+
+    const glm::vec3 inverseDirection = 1.0f / direction;
+
+    bvh.stack.clear();
+    bvh.stack.push_back(bvh.root);
+    while (!bvh.stack.empty())
+    {
+        const BvhNode& node = bvh.nodes[bvh.stack.back()];
+        bvh.stack.pop_back();
+
+        const f32 nodeDistance = RayAabbDistance(origin, inverseDirection, node.aabb);
+        if (nodeDistance < 0.0f || nodeDistance >= hitDistance)
+            continue;
+
+        if (node.child1 == BVH_NULL_NODE)
+        {
+            const f32 distance = callback(context, node.userData, origin, direction);
+            if (distance >= 0.0f && distance < hitDistance)
+            {
+                hitDistance = distance;
+                hitUserData = node.userData;
+            }
+        }
+        else
+        {
+            bvh.stack.push_back(node.child1);
+            bvh.stack.push_back(node.child2);
+        }
+    }
+
+    return hitUserData;
+}
+
+BvhBenchmarkResult RunBvhBenchmark(u32 objectCount, u32 queryCount)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    BvhBenchmarkResult result = {};
+    result.objectCount = objectCount;
+    result.queryCount = queryCount;
+
+    // Small boxes scattered in a cube, like a scene of props
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<f32> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<f32> extent(0.5f, 4.0f);
+
+    std::vector<Aabb> aabbs(objectCount);
+    for (u32 i = 0; i < objectCount; ++i)
+    {
+        const glm::vec3 center(position(random), position(random), position(random));
+        const glm::vec3 halfSize(extent(random), extent(random), extent(random));
+        aabbs[i].min = center - halfSize;
+        aabbs[i].max = center + halfSize;
+    }
+
+    // Cameras looking around from the middle of the scene
+    std::vector<Frustum> frustums(queryCount);
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+    for (u32 i = 0; i < queryCount; ++i)
+    {
+        const f32 angle = 6.2831853f * (f32)i / (f32)queryCount;
+        const glm::vec3 eye(position(random) * 0.5f, 0.0f, position(random) * 0.5f);
+        const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(cosf(angle), 0.0f, sinf(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+        frustums[i] = ExtractFrustum(projection * view);
+    }
+
+    Bvh bvh;
+    const Clock::time_point buildStart = Clock::now();
+    InitBvh(bvh, 0.1f);
+    for (u32 i = 0; i < objectCount; ++i)
+        BvhInsert(bvh, aabbs[i], i);
+    const Clock::time_point buildEnd = Clock::now();
+
+    u32 linearVisible = 0;
+    const Clock::time_point linearStart = Clock::now();
+    for (u32 q = 0; q < queryCount; ++q)
+        for (u32 i = 0; i < objectCount; ++i)
+            linearVisible += IsAabbVisible(frustums[q], aabbs[i]) ? 1 : 0;
+    const Clock::time_point linearEnd = Clock::now();
+
+    // The tree tests the fat boxes, so it may report a few more objects than the scan
+    std::vector<u32> results;
+    results.reserve(objectCount);
+    u32 bvhVisible = 0;
+    const Clock::time_point bvhStart = Clock::now();
+    for (u32 q = 0; q < queryCount; ++q)
+    {
+        results.clear();
+        BvhQueryFrustum(bvh, frustums[q], results);
+        bvhVisible += (u32)results.size();
+    }
+    const Clock::time_point bvhEnd = Clock::now();
+
+    result.buildMs = std::chrono::duration<f64, std::milli>(buildEnd - buildStart).count();
+    result.linearMs = std::chrono::duration<f64, std::milli>(linearEnd - linearStart).count() / queryCount;
+    result.bvhMs = std::chrono::duration<f64, std::milli>(bvhEnd - bvhStart).count() / queryCount;
+    result.visibleCount = bvhVisible / queryCount;
+
+    ILOG("BVH benchmark: %u objects, build %.3f ms, linear %.3f ms/query (%u visible), bvh %.3f ms/query (%u visible)",
+        objectCount, result.buildMs, result.linearMs, linearVisible / queryCount, result.bvhMs, result.visibleCount);
+    if (bvhVisible < linearVisible)
+        ELOG("BVH benchmark: the tree missed %u visible objects over %u queries", linearVisible - bvhVisible, queryCount);
+
+    return result;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "culling.h"
+
+#define BVH_NULL_NODE 0xffffffffu
+
+// Leaves store a "fat" box, enlarged by the tree margin, so objects that move a little
+// stay inside it and don't need to be reinserted.
+struct BvhNode
+{
+	Aabb aabb;
+	u32 parent; // also the next free node when the node is in the free list
+	u32 child1;
+	u32 child2;
+	i32 height; // 0 for leaves, -1 for free nodes
+	u32 userData;
+};
+
+// Dynamic bounding volume hierarchy (balanced AABB tree). Proxies are node indices and
+// stay valid until they are removed.
+struct Bvh
+{
+	std::vector<BvhNode> nodes;
+	u32 root;
+	u32 freeList;
+	u32 proxyCount;
+	f32 margin;
+
+	std::vector<u32> stack; // traversal scratch
+};
+
+struct BvhBenchmarkResult
+{
+	u32 objectCount;
+	u32 queryCount;
+	f64 buildMs;
+	f64 linearMs;
+	f64 bvhMs;
+	u32 visibleCount;
+};
+
+void InitBvh(Bvh& bvh, f32 margin);
+
+u32 BvhInsert(Bvh& bvh, const Aabb& aabb, u32 userData);
+
+void BvhRemove(Bvh& bvh, u32 proxy);
+
+/**
+ * Updates the box of a proxy. Returns false (and does nothing) if the new box is still
+ * inside the fat box of the leaf, which is the common case for small movements.
+ */
+bool BvhMove(Bvh& bvh, u32 proxy, const Aabb& aabb);
+
+/**
+ * Appends the user data of the leaves that intersect the frustum. Subtrees fully inside
+ * the frustum are added without testing their children.
+ */
+void BvhQueryFrustum(Bvh& bvh, const Frustum& frustum, std::vector<u32>& results);
+
+void BvhQuerySphere(Bvh& bvh, const glm::vec3& center, f32 radius, std::vector<u32>& results);
+
+// Returns the distance along the ray to the object, or a negative value if it's missed
+typedef f32 (*BvhRayCallback)(void* context, u32 userData, const glm::vec3& origin, const glm::vec3& direction);
+
+/**
+ * Returns the user data of the closest leaf hit by the ray, or BVH_NULL_NODE. The callback
+ * does the exact test against the object, nodes further than the best hit are skipped.
+ */
+u32 BvhRaycast(Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, BvhRayCallback callback, void* context, f32& hitDistance);
+
+/**
+ * Slab test. Returns the entry distance of the ray in the box, or a negative value if
+ * the ray misses it. Origins inside the box return 0.
+ */
+f32 RayAabbDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const Aabb& aabb);
+
+/**
+ * Times frustum queries over objectCount random boxes, with a linear scan and with the
+ * tree. Logs an error if the tree reports fewer visible objects than the scan, it can
+ * report more since it tests the fattened boxes.
+ */
+BvhBenchmarkResult RunBvhBenchmark(u32 objectCount, u32 queryCount);
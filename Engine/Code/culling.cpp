@@ -0,0 +1,147 @@
+#include "culling.h"
+
+#include <float.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+Aabb MakeEmptyAabb()
+{
+    Aabb aabb;
+    aabb.min = glm::vec3(FLT_MAX);
+    aabb.max = glm::vec3(-FLT_MAX);
+    return aabb;
+}
+
+void GrowAabb(Aabb& aabb, const glm::vec3& point)
+{
+    aabb.min = glm::min(aabb.min, point);
+    aabb.max = glm::max(aabb.max, point);
+}
+
+void GrowAabb(Aabb& aabb, const Aabb& other)
+{
+    aabb.min = glm::min(aabb.min, other.min);
+    aabb.max = glm::max(aabb.max, other.max);
+}
+
+Frustum ExtractFrustum(const glm::mat4& m)
+{
+    // glm is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0; // left
+    frustum.planes[1] = row3 - row0; // right
+    frustum.planes[2] = row3 + row1; // bottom
+    frustum.planes[3] = row3 - row1; // top
+    frustum.planes[4] = row3 + row2; // near
+    frustum.planes[5] = row3 - row2; // far
+
+    for (u32 i = 0; i < 6; ++i)
+        frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+    return frustum;
+}
+
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, f32 radius)
+{
+    for (u32 i = 0; i < 6; ++i)
+        if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius)
+            return false;
+    return true;
+}
+
+bool IsAabbVisible(const Frustum& frustum, const Aabb& aabb)
+{
+    for (u32 i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // The corner furthest along the plane normal
+        const glm::vec3 corner(
+            plane.x >= 0.0f ? aabb.max.x : aabb.min.x,
+            plane.y >= 0.0f ? aabb.max.y : aabb.min.y,
+            plane.z >= 0.0f ? aabb.max.z : aabb.min.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void ResizeSphereSoA(SphereSoA& spheres, u32 count)
+{
+    const u32 paddedCount = (count + 3) & ~3u;
+    spheres.centerX.resize(paddedCount, 0.0f);
+    spheres.centerY.resize(paddedCount, 0.0f);
+    spheres.centerZ.resize(paddedCount, 0.0f);
+    spheres.radius.resize(paddedCount, -FLT_MAX);
+    for (u32 i = count; i < paddedCount; ++i)
+        spheres.radius[i] = -FLT_MAX;
+    spheres.count = count;
+}
+
+void SetSphere(SphereSoA& spheres, u32 idx, const glm::vec3& center, f32 radius)
+{
+    spheres.centerX[idx] = center.x;
+    spheres.centerY[idx] = center.y;
+    spheres.centerZ[idx] = center.z;
+    spheres.radius[idx] = radius;
+}
+
+u32 CullSpheres(const Frustum& frustum, const SphereSoA& spheres, u8* visible)
+{
+    u32 visibleCount = 0;
+
+#ifdef CULLING_SSE
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (u32 p = 0; p < 6; ++p)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+
+    for (u32 i = 0; i < spheres.count; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&spheres.centerX[i]);
+        const __m128 cy = _mm_loadu_ps(&spheres.centerY[i]);
+        const __m128 cz = _mm_loadu_ps(&spheres.centerZ[i]);
+        const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+        __m128 inside = _mm_cmpeq_ps(cx, cx); // all bits set
+        for (u32 p = 0; p < 6; ++p)
+        {
+            __m128 distance = _mm_mul_ps(planeX[p], cx);
+            distance = _mm_add_ps(distance, _mm_mul_ps(planeY[p], cy));
+            distance = _mm_add_ps(distance, _mm_mul_ps(planeZ[p], cz));
+            distance = _mm_add_ps(distance, planeW[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        const u32 laneCount = glm::min(4u, spheres.count - i);
+        for (u32 lane = 0; lane < laneCount; ++lane)
+        {
+            visible[i + lane] = (mask >> lane) & 1;
+            visibleCount += visible[i + lane];
+        }
+    }
+#else
+    for (u32 i = 0; i < spheres.count; ++i)
+    {
+        const glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+        visible[i] = IsSphereVisible(frustum, center, spheres.radius[i]) ? 1 : 0;
+        visibleCount += visible[i];
+    }
+#endif
+
+    return visibleCount;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "platform.h"
+
+struct Aabb
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	f32 radius;
+};
+
+// Planes point inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Bounding spheres stored as structure of arrays so four of them can be tested against
+// a plane with a single SIMD instruction per component. Arrays are padded to a multiple
+// of four, padding spheres are never visible.
+struct SphereSoA
+{
+	std::vector<f32> centerX;
+	std::vector<f32> centerY;
+	std::vector<f32> centerZ;
+	std::vector<f32> radius;
+	u32 count;
+};
+
+Aabb MakeEmptyAabb();
+
+void GrowAabb(Aabb& aabb, const glm::vec3& point);
+
+void GrowAabb(Aabb& aabb, const Aabb& other);
+
+/**
+ * Extracts the six planes of a view-projection matrix (Gribb/Hartmann), normalized so
+ * plane distances are in world units.
+ */
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, f32 radius);
+
+bool IsAabbVisible(const Frustum& frustum, const Aabb& aabb);
+
+void ResizeSphereSoA(SphereSoA& spheres, u32 count);
+
+void SetSphere(SphereSoA& spheres, u32 idx, const glm::vec3& center, f32 radius);
+
+/**
+ * Writes 1 to visible[i] for every sphere that intersects the frustum and 0 otherwise.
+ * Returns the number of visible spheres. Uses SSE when the target supports it.
+ */
+u32 CullSpheres(const Frustum& frustum, const SphereSoA& spheres, u8* visible);
@@ -6,107 +6,279 @@
 //
 
 #include "importer.h"
+#include "texcompress.h"
+#include "texturecache.h"
+#include "programcache.h"
+#include "shadersource.h"
 #include <imgui.h>
+#include <algorithm>
 #include <stb_image.h>
 #include <stb_image_write.h>
 
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+/**
+ * Hands the stages and the link of a program to the driver without asking for their
+ * status, so with KHR_parallel_shader_compile they are built in the background while
+ * more programs are issued. FinishProgramCompile checks them.
+ */
+GLuint BeginProgramCompile(const std::string& programSource, const char* programName, const char* keywords, bool compute, ProgramCompile& compile)
+{
+    const GLenum stageTypes[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const char* stageDefines[] = { "VERTEX", "FRAGMENT" };
+
+    GLuint programHandle = glCreateProgram();
+    compile.shaderCount = compute ? 1 : ARRAY_COUNT(stageTypes);
+    for (u32 i = 0; i < compile.shaderCount; ++i)
+    {
+        const std::string preamble = MakeShaderPreamble(programName, keywords, compute ? "COMPUTE" : stageDefines[i]);
+        const GLchar* shaderSource[] = {
+            preamble.c_str(),
+            programSource.c_str()
+        };
+        const GLint shaderLengths[] = {
+            (GLint) preamble.size(),
+            (GLint) programSource.size()
+        };
+
+        compile.shaders[i] = glCreateShader(compute ? GL_COMPUTE_SHADER : stageTypes[i]);
+        glShaderSource(compile.shaders[i], ARRAY_COUNT(shaderSource), shaderSource, shaderLengths);
+        glCompileShader(compile.shaders[i]);
+        glAttachShader(programHandle, compile.shaders[i]);
+    }
+
+    glProgramParameteri(programHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(programHandle);
+
+    compile.handle = programHandle;
+    return programHandle;
+}
+
+// VAOs are created per program, the ones of a deleted program must go before its name is reused
+void DeleteProgramVAOs(App* app, GLuint programHandle)
+{
+    for (u32 m = 0; m < app->meshes.size(); ++m)
+    {
+        for (u32 i = 0; i < app->meshes[m].submeshes.size(); ++i)
+        {
+            std::vector<Vao>& vaos = app->meshes[m].submeshes[i].vaos;
+            for (u32 j = 0; j < vaos.size();)
+            {
+                if (vaos[j].programHandle == programHandle)
+                {
+                    glDeleteVertexArrays(1, &vaos[j].handle);
+                    vaos.erase(vaos.begin() + j);
+                }
+                else j++;
+            }
+        }
+    }
+}
+
+void ReplaceProgramHandle(App* app, Program& program, GLuint programHandle)
+{
+    DeleteProgramVAOs(app, program.handle);
+    glDeleteProgram(program.handle);
+    program.handle = programHandle;
+}
+
+/**
+ * Logs the errors of a compile and stores the binary of the program if it linked. A
+ * reloaded program only replaces the previous version if it linked, so a typo in a
+ * shader being edited leaves the last good version running.
+ */
+void FinishProgramCompile(App* app, const ProgramCompile& compile)
 {
     GLchar  infoLogBuffer[1024] = {};
     GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
     GLsizei infoLogSize;
     GLint   success;
 
-    char versionString[] = "#version 430\n";
-    char shaderNameDefine[128];
-    sprintf_s(shaderNameDefine, "#define %s\n", shaderName);
-    char vertexShaderDefine[] = "#define VERTEX\n";
-    char fragmentShaderDefine[] = "#define FRAGMENT\n";
-
-    const GLchar* vertexShaderSource[] = {
-        versionString,
-        shaderNameDefine,
-        vertexShaderDefine,
-        programSource.str
-    };
-    const GLint vertexShaderLengths[] = {
-        (GLint) strlen(versionString),
-        (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(vertexShaderDefine),
-        (GLint) programSource.len
-    };
-    const GLchar* fragmentShaderSource[] = {
-        versionString,
-        shaderNameDefine,
-        fragmentShaderDefine,
-        programSource.str
-    };
-    const GLint fragmentShaderLengths[] = {
-        (GLint) strlen(versionString),
-        (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(fragmentShaderDefine),
-        (GLint) programSource.len
-    };
-
-    GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
-    glCompileShader(vshader);
-    glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    Program& program = app->programs[compile.programIdx];
+    for (u32 i = 0; i < compile.shaderCount; ++i)
     {
-        glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        glGetShaderiv(compile.shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            const char* stageName = program.compute ? "compute" : i == 0 ? "vertex" : "fragment";
+            glGetShaderInfoLog(compile.shaders[i], infoLogBufferSize, &infoLogSize, infoLogBuffer);
+            ELOG("glCompileShader() failed with %s shader %s [%s]\nReported message:\n%s\n", stageName, program.programName.c_str(), program.keywords.c_str(), infoLogBuffer);
+        }
     }
 
-    GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fshader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
-    glCompileShader(fshader);
-    glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
+    glGetProgramiv(compile.handle, GL_LINK_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        glGetProgramInfoLog(compile.handle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s [%s]\nReported message:\n%s\n", program.programName.c_str(), program.keywords.c_str(), infoLogBuffer);
     }
 
-    GLuint programHandle = glCreateProgram();
-    glAttachShader(programHandle, vshader);
-    glAttachShader(programHandle, fshader);
-    glLinkProgram(programHandle);
-    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
-    if (!success)
+    for (u32 i = 0; i < compile.shaderCount; ++i)
     {
-        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        glDetachShader(compile.handle, compile.shaders[i]);
+        glDeleteShader(compile.shaders[i]);
     }
 
-    glUseProgram(0);
+    if (compile.handle != program.handle)
+    {
+        if (!success)
+        {
+            glDeleteProgram(compile.handle);
+            return;
+        }
+        ReplaceProgramHandle(app, program, compile.handle);
+        ILOG("Reloaded program %s [%s]", program.programName.c_str(), program.keywords.c_str());
+    }
 
-    glDetachShader(programHandle, vshader);
-    glDetachShader(programHandle, fshader);
-    glDeleteShader(vshader);
-    glDeleteShader(fshader);
+    SaveProgramBinary(program.filepath.c_str(), program.programName.c_str(), program.keywords.c_str(), compile.key, program.handle);
+}
 
-    return programHandle;
+// Checks the compiles the driver is done with, or every compile in flight if wait is set
+void FinishProgramCompiles(App* app, bool wait)
+{
+    u32 pendingCount = 0;
+    for (u32 i = 0; i < app->programCompiles.size(); ++i)
+    {
+        const ProgramCompile compile = app->programCompiles[i];
+        if (!wait && app->parallelShaderCompile)
+        {
+            GLint completed = GL_TRUE;
+            glGetProgramiv(compile.handle, GL_COMPLETION_STATUS_KHR, &completed);
+            if (!completed)
+            {
+                app->programCompiles[pendingCount++] = compile;
+                continue;
+            }
+        }
+        FinishProgramCompile(app, compile);
+    }
+    app->programCompiles.resize(pendingCount);
+}
+
+// Using a program that is still being compiled is fine but stalls until it is linked. One
+// being reloaded is ready, it runs its previous version meanwhile.
+bool IsProgramReady(App* app, u32 programIdx)
+{
+    for (u32 i = 0; i < app->programCompiles.size(); ++i)
+        if (app->programCompiles[i].programIdx == programIdx && app->programCompiles[i].handle == app->programs[programIdx].handle)
+            return false;
+    return true;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+u64 GetNewestWriteTimestamp(const std::vector<std::string>& files)
 {
-    String programSource = ReadTextFile(filepath);
+    u64 newest = 0;
+    for (u32 i = 0; i < files.size(); ++i)
+        newest = glm::max(newest, GetFileLastWriteTimestamp(files[i].c_str()));
+    return newest;
+}
+
+u32 LoadProgramPermutation(App* app, const char* filepath, const char* programName, const char* keywords, bool compute)
+{
+    const std::string cachePath = GetProgramCachePath(filepath, programName, keywords);
+    std::unordered_map<std::string, u32>::iterator it = app->programPermutations.find(cachePath);
+    if (it != app->programPermutations.end())
+        return it->second;
+
+    std::string programSource;
+    std::vector<std::string> sourceFiles;
+    PreprocessShaderSource(filepath, programSource, sourceFiles);
+    const u64 key = HashProgramSource(programSource, programName, keywords, compute ? "COMPUTE" : "VERTEX FRAGMENT", app->glInfo);
 
     Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
     program.filepath = filepath;
     program.programName = programName;
-    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    program.keywords = keywords;
+    program.compute = compute;
+    program.sourceFiles = sourceFiles;
+    program.lastWriteTimestamp = GetNewestWriteTimestamp(sourceFiles);
+    program.handle = LoadProgramBinary(filepath, programName, keywords, key);
+    for (u32 i = 0; i < sourceFiles.size(); ++i)
+        WatchFile(app->fileWatcher, sourceFiles[i].c_str());
+
+    const u32 programIdx = app->programs.size();
+    ProgramCompile compile = {};
+    if (!program.handle)
+    {
+        compile.programIdx = programIdx;
+        compile.key = key;
+        program.handle = BeginProgramCompile(programSource, programName, keywords, compute, compile);
+    }
     app->programs.push_back(program);
+    app->programPermutations[cachePath] = programIdx;
+
+    if (compile.shaderCount > 0)
+    {
+        if (app->parallelShaderCompile)
+            app->programCompiles.push_back(compile);
+        else
+            FinishProgramCompile(app, compile);
+    }
+
+    return programIdx;
+}
+
+u32 LoadProgram(App* app, const char* filepath, const char* programName, const char* keywords = "")
+{
+    return LoadProgramPermutation(app, filepath, programName, keywords, false);
+}
+
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName, const char* keywords = "")
+{
+    return LoadProgramPermutation(app, filepath, programName, keywords, true);
+}
+
+// Builds the program again from its files, it keeps its index and permutation
+void ReloadProgram(App* app, u32 programIdx)
+{
+    Program& program = app->programs[programIdx];
+
+    std::string programSource;
+    std::vector<std::string> sourceFiles;
+    if (!PreprocessShaderSource(program.filepath.c_str(), programSource, sourceFiles))
+        return;
+    const u64 key = HashProgramSource(programSource, program.programName.c_str(), program.keywords.c_str(), program.compute ? "COMPUTE" : "VERTEX FRAGMENT", app->glInfo);
+
+    // New includes are watched from now on
+    program.sourceFiles = sourceFiles;
+    program.lastWriteTimestamp = GetNewestWriteTimestamp(sourceFiles);
+    for (u32 i = 0; i < sourceFiles.size(); ++i)
+        WatchFile(app->fileWatcher, sourceFiles[i].c_str());
+
+    // Going back to a version that was built before doesn't need a compile
+    const GLuint binaryHandle = LoadProgramBinary(program.filepath.c_str(), program.programName.c_str(), program.keywords.c_str(), key);
+    if (binaryHandle)
+    {
+        ReplaceProgramHandle(app, program, binaryHandle);
+        ILOG("Reloaded program %s [%s] from its binary", program.programName.c_str(), program.keywords.c_str());
+        return;
+    }
+
+    ProgramCompile compile = {};
+    compile.programIdx = programIdx;
+    compile.key = key;
+    BeginProgramCompile(programSource, program.programName.c_str(), program.keywords.c_str(), program.compute, compile);
+    if (app->parallelShaderCompile)
+        app->programCompiles.push_back(compile);
+    else
+        FinishProgramCompile(app, compile);
+}
 
-    return app->programs.size() - 1;
+// The same program compiled with other keywords, it shares the vertex input layout
+u32 GetProgramPermutation(App* app, u32 programIdx, const char* keywords)
+{
+    const std::string filepath = app->programs[programIdx].filepath;
+    const std::string programName = app->programs[programIdx].programName;
+    const bool newPermutation = app->programPermutations.find(GetProgramCachePath(filepath.c_str(), programName.c_str(), keywords)) == app->programPermutations.end();
+
+    const u32 permutationIdx = LoadProgramPermutation(app, filepath.c_str(), programName.c_str(), keywords, app->programs[programIdx].compute);
+    if (newPermutation)
+        app->programs[permutationIdx].vertexInputLayout = app->programs[programIdx].vertexInputLayout;
+    return permutationIdx;
 }
 
 Image LoadImage(const char* filename)
 {
     Image img = {};
-    stbi_set_flip_vertically_on_load(true);
+    stbi_set_flip_vertically_on_load_thread(true);
     img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
     if (img.pixels)
     {
@@ -124,58 +296,322 @@ void FreeImage(Image image)
     stbi_image_free(image.pixels);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
+bool GetTextureFormats(i32 channelCount, GLenum& internalFormat, GLenum& dataFormat)
 {
-    GLenum internalFormat = GL_RGB8;
-    GLenum dataFormat     = GL_RGB;
-    GLenum dataType       = GL_UNSIGNED_BYTE;
+    switch (channelCount)
+    {
+        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; return true;
+        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; return true;
+        default: ELOG("LoadTexture2D() - Unsupported number of channels"); return false;
+    }
+}
+
+void SetTextureSampling(GLenum target, GLuint texHandle)
+{
+    glBindTexture(target, texHandle);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
 
-    switch (image.nchannels)
+// Takes a free layer of an array of the bucket of this size, format and level count, or
+// creates a new array for the bucket if they are all full. layerSize is only used to
+// account for the storage of new arrays.
+void AllocTextureLayer(App* app, glm::ivec2 size, GLenum internalFormat, u32 levelCount, u32 layerSize, u32& arrayIdx, u32& layer)
+{
+    u32 bucketLayerCount = 0;
+    for (u32 i = 0; i < app->textureArrays.size(); ++i)
     {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
+        TextureArray& array = app->textureArrays[i];
+        if (array.size != size || array.internalFormat != internalFormat || array.levelCount != levelCount)
+            continue;
+
+        if (!array.freeLayers.empty())
+        {
+            arrayIdx = i;
+            layer = array.freeLayers.back();
+            array.freeLayers.pop_back();
+            return;
+        }
+        bucketLayerCount += array.layerCount;
     }
 
-    GLuint texHandle;
-    glGenTextures(1, &texHandle);
-    glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    TextureArray array = {};
+    array.size = size;
+    array.internalFormat = internalFormat;
+    array.levelCount = levelCount;
+    array.layerCount = glm::clamp(bucketLayerCount, (u32)TEXTURE_ARRAY_MIN_LAYERS, (u32)TEXTURE_ARRAY_MAX_LAYERS);
+    array.layerSize = layerSize;
+    app->textureArrayBytes += (u64)layerSize * array.layerCount;
+
+    glGenTextures(1, &array.handle);
+    SetTextureSampling(GL_TEXTURE_2D_ARRAY, array.handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, internalFormat, size.x, size.y, array.layerCount);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The sampling state can't change once the array has a handle, the layers still can
+    if (app->bindlessTextures)
+    {
+        array.bindlessHandle = glGetTextureHandleARB(array.handle);
+        glMakeTextureHandleResidentARB(array.bindlessHandle);
+    }
+
+    for (u32 l = array.layerCount - 1; l > 0; --l)
+        array.freeLayers.push_back(l);
+
+    arrayIdx = (u32)app->textureArrays.size();
+    layer = 0;
+    app->textureArrays.push_back(array);
+}
+
+void FreeTextureLayer(App* app, u32 arrayIdx, u32 layer)
+{
+    app->textureArrays[arrayIdx].freeLayers.push_back(layer);
+}
+
+GLuint CreateTextureLayerView(const TextureArray& array, u32 layer)
+{
+    GLuint view;
+    glGenTextures(1, &view);
+    glTextureView(view, GL_TEXTURE_2D, array.handle, array.internalFormat, 0, array.levelCount, layer, 1);
+    SetTextureSampling(GL_TEXTURE_2D, view);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return view;
+}
+
+// Textures loading in the background use the layer of a placeholder until they stream in
+bool IsSharingPlaceholder(App* app, u32 texIdx)
+{
+    const u32 placeholders[] = { app->whiteTexIdx, app->blackTexIdx, app->normalTexIdx, app->magentaTexIdx };
+    for (u32 i = 0; i < ARRAY_COUNT(placeholders); ++i)
+        if (placeholders[i] != texIdx && app->textures[placeholders[i]].handle == app->textures[texIdx].handle)
+            return true;
+    return false;
+}
+
+// Allocates every level of the texture and queues them for streaming, the texture keeps
+// its placeholder until the smallest one is in. A reloaded texture keeps its previous
+// version until all of them are.
+void BeginTextureStream(App* app, u32 texIdx, MipChain* mips)
+{
+    GLenum internalFormat = GetTextureCodecFormat(mips->codec);
+    GLenum dataFormat = internalFormat;
+    if (mips->codec == TextureCodec_None && !GetTextureFormats(mips->channelCount, internalFormat, dataFormat))
+    {
+        delete mips;
+        return;
+    }
+
+    TextureStreamRequest request = {};
+    request.texIdx = texIdx;
+    request.dataFormat = dataFormat;
+    request.mips = mips;
+    request.level = (i32)mips->levelCount - 1;
+    request.reload = !IsSharingPlaceholder(app, texIdx);
+
+    AllocTextureLayer(app, mips->levelSizes[0], internalFormat, mips->levelCount, (u32)mips->pixels.size(), request.arrayIdx, request.layer);
+    request.view = CreateTextureLayerView(app->textureArrays[request.arrayIdx], request.layer);
+    glBindTexture(GL_TEXTURE_2D, request.view);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, request.level);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    return texHandle;
+    app->textureStreamRequests.push_back(request);
 }
 
 u32 LoadTexture2D(App* app, const char* filepath)
 {
-    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx].filepath == filepath)
-            return texIdx;
+    const AssetKey key = MakeAssetKey(AssetType_Texture, filepath);
+    const u32 loadedTexIdx = AcquireAsset(app->assets, key);
+    if (loadedTexIdx != UINT32_MAX)
+        return loadedTexIdx;
 
     Image image = LoadImage(filepath);
+    if (!image.pixels)
+        return UINT32_MAX;
+
+    GLenum internalFormat = GL_RGB8;
+    GLenum dataFormat = GL_RGB;
+    if (!GetTextureFormats(image.nchannels, internalFormat, dataFormat))
+    {
+        FreeImage(image);
+        return UINT32_MAX;
+    }
+
+    MipChain mips;
+    BuildMipChain((const u8*)image.pixels, image.size, image.nchannels, mips);
+    FreeImage(image);
+
+    Texture tex = {};
+    tex.filepath = filepath;
+    tex.codec = TextureCodec_None;
+    tex.kind = TextureKind_Color;
+    tex.size = (u32)mips.pixels.size();
+    AllocTextureLayer(app, mips.levelSizes[0], internalFormat, mips.levelCount, tex.size, tex.arrayIdx, tex.layer);
+
+    // Small enough to go in one go, without the upload ring
+    glBindTexture(GL_TEXTURE_2D_ARRAY, app->textureArrays[tex.arrayIdx].handle);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (u32 level = 0; level < mips.levelCount; ++level)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, tex.layer, mips.levelSizes[level].x, mips.levelSizes[level].y, 1,
+            dataFormat, GL_UNSIGNED_BYTE, mips.pixels.data() + mips.levelOffsets[level]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    tex.handle = CreateTextureLayerView(app->textureArrays[tex.arrayIdx], tex.layer);
+    app->textureBytes[tex.codec] += tex.size;
+
+    u32 texIdx = app->textures.size();
+    app->textures.push_back(tex);
+    RegisterAsset(app->assets, key, AssetType_Texture, texIdx, filepath);
+    WatchFile(app->fileWatcher, filepath);
+    app->textureTableDirty = true;
+
+    return texIdx;
+}
 
-    if (image.pixels)
+// Runs on a worker. Cooks the texture if it has no up to date cooked file.
+MipChain* LoadTextureMips(const std::string& path, TextureKind kind, u32 codecMask)
+{
+    MappedFile source = MapFile(path.c_str());
+    if (!source.data)
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
+        ELOG("Could not open file %s", path.c_str());
+        return NULL;
+    }
+    const u64 sourceHash = HashTextureSource(source, kind, codecMask);
+    UnmapFile(source);
 
-        u32 texIdx = app->textures.size();
-        app->textures.push_back(tex);
+    MipChain* mips = new MipChain();
+    if (ReadTextureCache(path.c_str(), sourceHash, *mips))
+        return mips;
 
-        FreeImage(image);
-        return texIdx;
+    Image image = LoadImage(path.c_str());
+    if (!image.pixels)
+    {
+        delete mips;
+        return NULL;
     }
-    else
+    BuildMipChain((const u8*)image.pixels, image.size, image.nchannels, *mips);
+    FreeImage(image);
+
+    const TextureCodec codec = ChooseTextureCodec(kind, *mips, codecMask);
+    if (codec != TextureCodec_None)
     {
-        return UINT32_MAX;
+        MipChain compressed;
+        CompressMipChain(*mips, codec, compressed);
+        ILOG("Compressed %s to %s: %.2f MB -> %.2f MB", path.c_str(), GetTextureCodecName(codec),
+             mips->pixels.size() / (1024.0f * 1024.0f), compressed.pixels.size() / (1024.0f * 1024.0f));
+        *mips = std::move(compressed);
+    }
+
+    WriteTextureCache(path.c_str(), sourceHash, *mips);
+    return mips;
+}
+
+// Decodes (or cooks) the texture file on a worker and streams it in from the completion
+void PushTextureLoad(App* app, u32 texIdx)
+{
+    JobSystem* jobSystem = &app->jobSystem;
+    const std::string path = app->textures[texIdx].filepath;
+    const TextureKind kind = app->textures[texIdx].kind;
+    const u32 codecMask = app->textureCodecMask;
+    PushJob(*jobSystem, [app, jobSystem, path, texIdx, kind, codecMask]() {
+        MipChain* mips = LoadTextureMips(path, kind, codecMask);
+
+        PushCompletion(*jobSystem, [app, mips, texIdx, path]() {
+            if (!mips)
+                return;
+
+            // Skip the upload if the texture was released while it was being decoded
+            if (app->textures[texIdx].filepath != path)
+                delete mips;
+            else
+                BeginTextureStream(app, texIdx, mips);
+        });
+    });
+}
+
+u32 LoadTexture2DAsync(App* app, const char* filepath, u32 placeholderIdx, TextureKind kind)
+{
+    const AssetKey key = MakeAssetKey(AssetType_Texture, filepath);
+    const u32 loadedTexIdx = AcquireAsset(app->assets, key);
+    if (loadedTexIdx != UINT32_MAX)
+        return loadedTexIdx;
+
+    // Shares the placeholder's layer, only its own layer counts as its size
+    const Texture& placeholder = app->textures[placeholderIdx];
+    Texture tex = {};
+    tex.handle = placeholder.handle;
+    tex.filepath = filepath;
+    tex.arrayIdx = placeholder.arrayIdx;
+    tex.layer = placeholder.layer;
+    tex.minLevel = placeholder.minLevel;
+    tex.kind = kind;
+
+    u32 texIdx = app->textures.size();
+    app->textures.push_back(tex);
+    RegisterAsset(app->assets, key, AssetType_Texture, texIdx, filepath);
+    WatchFile(app->fileWatcher, filepath);
+    app->textureTableDirty = true;
+
+    PushTextureLoad(app, texIdx);
+    return texIdx;
+}
+
+// Returns false if the texture can't be reloaded yet because it is still streaming in
+bool ReloadTexture(App* app, u32 texIdx)
+{
+    for (u32 i = 0; i < app->textureStreamRequests.size(); ++i)
+        if (app->textureStreamRequests[i].texIdx == texIdx && app->textureStreamRequests[i].level >= 0)
+            return false;
+
+    // Other textures share the layers of the placeholders, those stay as they are
+    const u32 placeholders[] = { app->whiteTexIdx, app->blackTexIdx, app->normalTexIdx, app->magentaTexIdx };
+    for (u32 i = 0; i < ARRAY_COUNT(placeholders); ++i)
+    {
+        if (placeholders[i] == texIdx)
+        {
+            ILOG("%s is a placeholder, restart to see the changes", app->textures[texIdx].filepath.c_str());
+            return true;
+        }
+    }
+
+    PushTextureLoad(app, texIdx);
+    return true;
+}
+
+void ReleaseTexture(App* app, u32 texIdx)
+{
+    // Released already if the key isn't registered, the slot then holds the magenta texture
+    Texture& tex = app->textures[texIdx];
+    const u32 refCount = ReleaseAsset(app->assets, MakeAssetKey(AssetType_Texture, tex.filepath.c_str()));
+    if (refCount == UINT32_MAX || refCount > 0)
+        return;
+
+    // Placeholders are shared, only the texture's own handle is deleted. The slot stays
+    // so the indices of the other textures don't change
+    if (!IsSharingPlaceholder(app, texIdx))
+    {
+        glDeleteTextures(1, &tex.handle);
+        FreeTextureLayer(app, tex.arrayIdx, tex.layer);
     }
+    app->textureBytes[tex.codec] -= tex.size;
+    tex.size = 0;
+
+    const Texture& magenta = app->textures[app->magentaTexIdx];
+    tex.handle = magenta.handle;
+    tex.arrayIdx = magenta.arrayIdx;
+    tex.layer = magenta.layer;
+    tex.minLevel = magenta.minLevel;
+    tex.filepath.clear();
+    app->textureTableDirty = true;
+}
+
+// Maps the quantized positions of the mesh back to object space
+glm::mat4 GetMeshDequantization(const Mesh& mesh)
+{
+    return glm::translate(mesh.positionOffset) * glm::scale(glm::vec3(mesh.positionScale));
 }
 
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
@@ -205,11 +641,12 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
             {
                 if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
                 {
-                    const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-                    const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componentCount;
-                    const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset;
+                    const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+                    const u32 index = attribute.location;
+                    const u32 ncomp = attribute.componentCount;
+                    const u32 offset = attribute.offset + submesh.vertexOffset;
                     const u32 stride = submesh.vertexBufferLayout.stride;
-                    glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
+                    glVertexAttribPointer(index, ncomp, GetVertexAttributeGLType(attribute.type), IsVertexAttributeNormalized(attribute.type), stride, (void*)(u64)offset);
                     glEnableVertexAttribArray(index);
 
                     attributeWasLinked = true;
@@ -296,317 +733,1760 @@ void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 #define PushMat3(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
 #define PushMat4(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
 
-void CreateFramebuffer(Framebuffer &fb, ivec2 &display)
+RingBuffer CreateRingBuffer(u32 regionSize, u32 regionCount, GLenum type)
 {
-    glGenTextures(1, &fb.colorAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, fb.colorAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    ASSERT(regionCount > 0 && regionCount <= RING_BUFFER_MAX_REGIONS, "Unsupported number of ring buffer regions");
 
-    glGenTextures(1, &fb.positionAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, fb.positionAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    RingBuffer ring = {};
+    ring.size = regionSize * regionCount;
+    ring.type = type;
+    ring.regionSize = regionSize;
+    ring.regionCount = regionCount;
+    ring.regionIdx = regionCount - 1; // The first BeginRingBufferFrame() moves to region 0
 
-    glGenTextures(1, &fb.normalAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, fb.normalAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenBuffers(1, &ring.handle);
+    glBindBuffer(type, ring.handle);
 
-    glGenTextures(1, &fb.depthAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, fb.depthAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, display.x, display.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if (glBufferStorage)
+    {
+        // Mapped once, the pointer stays valid until the buffer is deleted
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(type, ring.size, NULL, flags);
+        ring.data = (u8*)glMapBufferRange(type, 0, ring.size, flags);
+        ring.persistent = ring.data != NULL;
+    }
+    else
+    {
+        glBufferData(type, ring.size, NULL, GL_STREAM_DRAW);
+    }
 
-    glGenFramebuffers(1, &fb.framebufferHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb.framebufferHandle);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, fb.colorAttachmentHandle, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, fb.normalAttachmentHandle, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, fb.positionAttachmentHandle, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, fb.depthAttachmentHandle, 0);
+    glBindBuffer(type, 0);
 
-    fb.framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (fb.framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+    return ring;
+}
+
+void WaitRingBufferRegion(RingBuffer& ring, u32 regionIdx)
+{
+    GLsync& fence = ring.fences[regionIdx];
+    if (!fence)
+        return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
     {
-        switch (fb.framebufferStatus)
+        // The GPU is still reading this region from regionCount frames ago
+        ring.stallCount++;
+        do
         {
-        case GL_FRAMEBUFFER_UNDEFINED: ELOG("GL_FRAMEBUFFER_UNDEFINED"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT: ELOG("GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT: ELOG("GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER: ELOG("GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER: ELOG("GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER"); break;
-        case GL_FRAMEBUFFER_UNSUPPORTED: ELOG("GL_FRAMEBUFFER_UNSUPPORTED"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE: ELOG("GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE"); break;
-        case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS: ELOG("GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS"); break;
-        default: ELOG("Unknown framebuffer status error"); break;
-        }
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while (result == GL_TIMEOUT_EXPIRED);
     }
 
-    GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, drawBuffers);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteSync(fence);
+    fence = 0;
 }
 
-void Init(App* app)
+void BeginRingBufferFrame(RingBuffer& ring)
 {
-    app->cam = Camera(glm::vec3(0.0f, 0.0f, 10.0f));
+    ring.regionIdx = (ring.regionIdx + 1) % ring.regionCount;
+    WaitRingBufferRegion(ring, ring.regionIdx);
 
-    // TODO: Initialize your resources here!
-    // - vertex buffers
-    // - element/index buffers
-    // - vaos
-    // - programs (and retrieve uniform indices)
-    // - textures
+    if (!ring.persistent)
+    {
+        // Fallback without ARB_buffer_storage: the fences already protect the regions
+        // still in flight, so the driver doesn't need to synchronize the map
+        glBindBuffer(ring.type, ring.handle);
+        ring.data = (u8*)glMapBufferRange(ring.type, 0, ring.size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    }
 
-    app->mode = Mode_Model;
+    ring.head = ring.regionIdx * ring.regionSize;
+}
 
-    //if (app->mode == Mode_Model)
+void EndRingBufferFrame(RingBuffer& ring)
+{
+    const u32 regionStart = ring.regionIdx * ring.regionSize;
+    ASSERT(ring.head <= regionStart + ring.regionSize, "Ring buffer region overflow");
+
+    if (!ring.persistent)
     {
+        glFlushMappedBufferRange(ring.type, regionStart, ring.head - regionStart);
+        glUnmapBuffer(ring.type);
+        glBindBuffer(ring.type, 0);
+        ring.data = NULL;
+    }
+}
 
-    //glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_CULL_FACE);
+// Call once all the draw calls that read the current region have been issued
+void FenceRingBufferFrame(RingBuffer& ring)
+{
+    GLsync& fence = ring.fences[ring.regionIdx];
+    if (fence)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
 
-    //Geometry
-    // Display Buffer
-    glGenBuffers(1, &app->embeddedVertices);
-    glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+PagedBuffer CreatePagedBuffer(u32 pageSize, GLenum type)
+{
+    PagedBuffer paged = {};
+    paged.pageSize = pageSize;
+    paged.type = type;
+    paged.pages.push_back(CreateRingBuffer(pageSize, RING_BUFFER_FRAME_COUNT, type));
+    return paged;
+}
 
-    glGenBuffers(1, &app->embeddedElements);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void BeginPagedBufferFrame(PagedBuffer& paged)
+{
+    paged.pageIdx = 0;
+    BeginRingBufferFrame(paged.pages[0]);
+}
 
-    // Attribute state
-    glGenVertexArrays(1, &app->vao);
-    glBindVertexArray(app->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
+// Makes room for a block of size bytes and returns the page it has to be pushed into.
+// page and offset receive the location of the block, to be used with glBindBufferRange.
+RingBuffer& AllocPagedBlock(PagedBuffer& paged, u32 size, u32 alignment, u32& page, u32& offset)
+{
+    ASSERT(size <= paged.pageSize, "The block doesn't fit in a page");
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)(3 * sizeof(float)));
+    RingBuffer* ring = &paged.pages[paged.pageIdx];
+    AlignHead(*ring, alignment);
+
+    const u32 regionEnd = (ring->regionIdx + 1) * ring->regionSize;
+    if (ring->head + size > regionEnd)
+    {
+        EndRingBufferFrame(*ring);
+
+        paged.pageIdx++;
+        if (paged.pageIdx == paged.pages.size())
+        {
+            paged.pages.push_back(CreateRingBuffer(paged.pageSize, RING_BUFFER_FRAME_COUNT, paged.type));
+        }
+
+        ring = &paged.pages[paged.pageIdx];
+        BeginRingBufferFrame(*ring);
+    }
+
+    page = paged.pageIdx;
+    offset = ring->head;
+    return *ring;
+}
+
+void EndPagedBufferFrame(PagedBuffer& paged)
+{
+    EndRingBufferFrame(paged.pages[paged.pageIdx]);
+}
+
+void FencePagedBufferFrame(PagedBuffer& paged)
+{
+    for (u32 i = 0; i <= paged.pageIdx; ++i)
+        FenceRingBufferFrame(paged.pages[i]);
+}
+
+// Recreates the ring with bigger regions if regionSize doesn't fit. Must be called before
+// BeginRingBufferFrame(). The data of the previous frames is discarded.
+void ReserveRingBuffer(RingBuffer& ring, u32 regionSize, u32 alignment)
+{
+    if (regionSize <= ring.regionSize)
+        return;
+
+    for (u32 i = 0; i < ring.regionCount; ++i)
+        if (ring.fences[i])
+            glDeleteSync(ring.fences[i]);
+
+    // Deleting a buffer that is still in use is fine, the driver keeps it alive
+    glDeleteBuffers(1, &ring.handle);
+
+    const u32 stallCount = ring.stallCount;
+    ring = CreateRingBuffer(Align(glm::max(regionSize, ring.regionSize * 2), alignment), ring.regionCount, ring.type);
+    ring.stallCount = stallCount;
+}
+
+/**
+ * Copies up to textureStreamBudget bytes of the queued textures into the upload ring and
+ * submits them with glTexSubImage2D. Textures take turns one level at a time, so every
+ * texture gets its small levels before any gets its large ones. A level that doesn't fit
+ * goes in bands of rows over several frames, and the base level of a texture only moves
+ * down once a whole level is in.
+ */
+void StreamTextures(App* app)
+{
+    app->textureUploadBytes = 0;
+
+    // Released textures stop streaming. The requests are dropped at the end, which frees
+    // the view and layer of those that never became resident
+    for (u32 i = 0; i < app->textureStreamRequests.size(); ++i)
+    {
+        TextureStreamRequest& request = app->textureStreamRequests[i];
+        if (app->textures[request.texIdx].filepath.empty())
+            request.level = -1;
+    }
+
+    if (app->textureStreamRequests.empty())
+        return;
+
+    RingBuffer& ring = app->textureUploadBuffer;
+    const u32 budget = glm::min(app->textureStreamBudget, ring.regionSize);
+    app->textureStreamUploads.clear();
+
+    BeginRingBufferFrame(ring);
+
+    bool copied = true;
+    while (copied && app->textureUploadBytes < budget)
+    {
+        copied = false;
+        for (u32 i = 0; i < app->textureStreamRequests.size(); ++i)
+        {
+            TextureStreamRequest& request = app->textureStreamRequests[i];
+            if (request.level < 0)
+                continue;
+
+            // Compressed levels go in rows of blocks
+            const MipChain& mips = *request.mips;
+            const u32 levelRowCount = GetMipRowCount(mips, request.level);
+            const u32 rowBytes = GetMipRowSize(mips, request.level);
+            const u32 rowCount = glm::min(levelRowCount - request.row, (budget - app->textureUploadBytes) / rowBytes);
+            if (rowCount == 0)
+                continue;
+
+            const u32 bytes = rowCount * rowBytes;
+            memcpy(ring.data + ring.head, mips.pixels.data() + mips.levelOffsets[request.level] + request.row * rowBytes, bytes);
+
+            TextureStreamUpload upload = {};
+            upload.arrayHandle = app->textureArrays[request.arrayIdx].handle;
+            upload.view = request.view;
+            upload.layer = request.layer;
+            upload.dataFormat = request.dataFormat;
+            upload.level = request.level;
+            upload.row = mips.codec == TextureCodec_None ? request.row : request.row * TEXTURE_BLOCK_SIZE;
+            upload.rowCount = GetMipTexelRows(mips, request.level, request.row, rowCount);
+            upload.width = mips.levelSizes[request.level].x;
+            upload.offset = ring.head;
+            upload.size = bytes;
+            upload.compressed = mips.codec != TextureCodec_None;
+            upload.completesLevel = request.row + rowCount == levelRowCount;
+            app->textureStreamUploads.push_back(upload);
+
+            ring.head += bytes;
+            app->textureUploadBytes += bytes;
+            copied = true;
+
+            request.row += rowCount;
+            if (upload.completesLevel)
+            {
+                request.level--;
+                request.row = 0;
+            }
+        }
+    }
+
+    EndRingBufferFrame(ring);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.handle);
+    for (u32 i = 0; i < app->textureStreamUploads.size(); ++i)
+    {
+        const TextureStreamUpload& upload = app->textureStreamUploads[i];
+        glBindTexture(GL_TEXTURE_2D_ARRAY, upload.arrayHandle);
+        if (upload.compressed)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, upload.level, 0, upload.row, upload.layer, upload.width, upload.rowCount, 1,
+                upload.dataFormat, upload.size, (void*)(u64)upload.offset);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, upload.level, 0, upload.row, upload.layer, upload.width, upload.rowCount, 1,
+                upload.dataFormat, GL_UNSIGNED_BYTE, (void*)(u64)upload.offset);
+
+        // The shaders that sample the arrays clamp to the table's minLevel instead
+        if (upload.completesLevel)
+        {
+            glBindTexture(GL_TEXTURE_2D, upload.view);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.level);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    FenceRingBufferFrame(ring);
+
+    // Swap the placeholders for the textures that got their first level, and the previous
+    // versions of the reloaded ones once they got all of them. Drop the finished requests
+    u32 pendingCount = 0;
+    for (u32 i = 0; i < app->textureStreamRequests.size(); ++i)
+    {
+        TextureStreamRequest& request = app->textureStreamRequests[i];
+        Texture& tex = app->textures[request.texIdx];
+        const bool swap = request.reload ? request.level < 0 : request.level < (i32)request.mips->levelCount - 1;
+        if (!request.resident && !tex.filepath.empty() && swap)
+        {
+            if (request.reload)
+            {
+                glDeleteTextures(1, &tex.handle);
+                FreeTextureLayer(app, tex.arrayIdx, tex.layer);
+                app->textureBytes[tex.codec] -= tex.size;
+                ILOG("Reloaded texture %s", tex.filepath.c_str());
+            }
+            tex.handle = request.view;
+            tex.arrayIdx = request.arrayIdx;
+            tex.layer = request.layer;
+            tex.codec = request.mips->codec;
+            tex.size = (u32)request.mips->pixels.size();
+            app->textureBytes[tex.codec] += tex.size;
+            request.resident = true;
+            app->textureTableDirty = true;
+        }
+        if (request.resident && !tex.filepath.empty() && tex.minLevel != (u32)(request.level + 1))
+        {
+            tex.minLevel = request.level + 1;
+            app->textureTableDirty = true;
+        }
+
+        if (request.level >= 0)
+        {
+            app->textureStreamRequests[pendingCount++] = request;
+            continue;
+        }
+
+        // The texture was released before its view replaced anything
+        if (!request.resident)
+        {
+            glDeleteTextures(1, &request.view);
+            FreeTextureLayer(app, request.arrayIdx, request.layer);
+        }
+        delete request.mips;
+    }
+    app->textureStreamRequests.resize(pendingCount);
+}
+
+void UpdateTextureTable(App* app)
+{
+    if (!app->textureTableDirty)
+        return;
+
+    app->textureTable.resize(app->textures.size());
+    for (u32 i = 0; i < app->textures.size(); ++i)
+    {
+        const Texture& tex = app->textures[i];
+        GpuTexture& entry = app->textureTable[i];
+        entry.layer = tex.layer;
+        entry.minLevel = (f32)tex.minLevel;
+        entry.arrayHandle = app->textureArrays[tex.arrayIdx].bindlessHandle;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->textureTableBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, app->textureTable.size() * sizeof(GpuTexture), app->textureTable.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    app->textureTableDirty = false;
+}
+
+void UpdateMaterialTable(App* app)
+{
+    if (!app->materialsDirty)
+        return;
+
+    app->materialTable.resize(app->materials.size());
+    for (u32 i = 0; i < app->materials.size(); ++i)
+    {
+        const Material& material = app->materials[i];
+        GpuMaterial& entry = app->materialTable[i];
+        entry.albedo = material.albedo;
+        entry.smoothness = material.smoothness;
+        entry.emissive = material.emissive;
+        entry.albedoTextureIdx = material.albedoTextureIdx;
+        entry.emissiveTextureIdx = material.emissiveTextureIdx;
+        entry.specularTextureIdx = material.specularTextureIdx;
+        entry.normalsTextureIdx = material.normalsTextureIdx;
+        entry.bumpTextureIdx = material.bumpTextureIdx;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, app->materialTable.size() * sizeof(GpuMaterial), app->materialTable.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    app->materialsDirty = false;
+}
+
+void GrowArenaBuffer(GLuint& handle, u32& capacity, u32 usedBytes, u32 requiredBytes)
+{
+    if (requiredBytes <= capacity)
+        return;
+
+    const u32 newCapacity = glm::max(requiredBytes, glm::max(capacity * 2, (u32)KB(256)));
+
+    GLuint newHandle;
+    glGenBuffers(1, &newHandle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newHandle);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+
+    if (usedBytes > 0)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, handle);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (handle)
+        glDeleteBuffers(1, &handle);
+
+    handle = newHandle;
+    capacity = newCapacity;
+}
+
+void AddMeshToGeometryArena(App* app, Mesh& mesh, const u8* vertexData, const u8* indexData)
+{
+    GeometryArena& arena = app->geometryArena;
+    std::vector<ArenaVertex> arenaVertices;
+    std::vector<u32> arenaIndices;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+        const VertexBufferLayout& layout = submesh.vertexBufferLayout;
+
+        // Byte offsets of the attributes the arena keeps, UINT32_MAX if missing. They are
+        // already quantized to the arena types, so they are copied as they are
+        u32 attributeOffsets[3] = { UINT32_MAX, UINT32_MAX, UINT32_MAX };
+        for (u32 j = 0; j < layout.attributes.size(); ++j)
+            if (layout.attributes[j].location < ARRAY_COUNT(attributeOffsets))
+                attributeOffsets[layout.attributes[j].location] = layout.attributes[j].offset;
+
+        const u32 vertexCount = submesh.vertexCount;
+
+        arenaVertices.resize(vertexCount);
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const u8* src = vertexData + submesh.vertexOffset + v * layout.stride;
+            ArenaVertex& dst = arenaVertices[v];
+            memcpy(dst.position, src + attributeOffsets[0], sizeof(dst.position));
+            memcpy(&dst.normal, src + attributeOffsets[1], sizeof(dst.normal));
+            dst.texCoord = 0;
+            if (attributeOffsets[2] != UINT32_MAX)
+                memcpy(&dst.texCoord, src + attributeOffsets[2], sizeof(dst.texCoord));
+        }
+
+        const u32 vertexBytes = arena.vertexCount * sizeof(ArenaVertex);
+        const u32 indexBytes = arena.indexCount * sizeof(u32);
+        const u32 newVertexBytes = vertexCount * sizeof(ArenaVertex);
+        const u32 newIndexBytes = submesh.indexCount * sizeof(u32);
+
+        // The arena is drawn with a single multi-draw, so its indices are all 32 bits
+        const u32* indices = (const u32*)(indexData + submesh.indexOffset);
+        if (submesh.indexType == GL_UNSIGNED_SHORT)
+        {
+            const u16* indices16 = (const u16*)(indexData + submesh.indexOffset);
+            arenaIndices.assign(indices16, indices16 + submesh.indexCount);
+            indices = arenaIndices.data();
+        }
+
+        const GLuint previousVertexBuffer = arena.vertexBufferHandle;
+        const GLuint previousIndexBuffer = arena.indexBufferHandle;
+        GrowArenaBuffer(arena.vertexBufferHandle, arena.vertexCapacity, vertexBytes, vertexBytes + newVertexBytes);
+        GrowArenaBuffer(arena.indexBufferHandle, arena.indexCapacity, indexBytes, indexBytes + newIndexBytes);
+        if (arena.vertexBufferHandle != previousVertexBuffer || arena.indexBufferHandle != previousIndexBuffer)
+            arena.vaoDirty = true;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBufferHandle);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexBytes, newVertexBytes, arenaVertices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBufferHandle);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexBytes, newIndexBytes, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        submesh.arenaBaseVertex = arena.vertexCount;
+        submesh.arenaFirstIndex = arena.indexCount;
+        arena.vertexCount += vertexCount;
+        arena.indexCount += submesh.indexCount;
+    }
+}
+
+void ReserveGeometryArenaDraws(GeometryArena& arena, u32 drawCount)
+{
+    if (drawCount <= arena.drawIdCapacity)
+        return;
+
+    arena.drawIdCapacity = glm::max(drawCount, glm::max(arena.drawIdCapacity * 2, 1024u));
+
+    std::vector<u32> drawIds(arena.drawIdCapacity);
+    for (u32 i = 0; i < arena.drawIdCapacity; ++i)
+        drawIds[i] = i;
+
+    if (arena.drawIdBufferHandle)
+        glDeleteBuffers(1, &arena.drawIdBufferHandle);
+
+    glGenBuffers(1, &arena.drawIdBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, arena.drawIdBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(u32), drawIds.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    arena.vaoDirty = true;
+}
+
+GLuint GetGeometryArenaVAO(GeometryArena& arena)
+{
+    if (!arena.vaoDirty)
+        return arena.vao;
+
+    if (arena.vao)
+        glDeleteVertexArrays(1, &arena.vao);
+
+    glGenVertexArrays(1, &arena.vao);
+    glBindVertexArray(arena.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBufferHandle);
+    glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, normal));
     glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, texCoord));
+    glEnableVertexAttribArray(2);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
+    // With a divisor this big the attribute never advances inside a command, so every
+    // instance reads drawIds[baseInstance], which is the index of the command itself
+    glBindBuffer(GL_ARRAY_BUFFER, arena.drawIdBufferHandle);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(u32), (void*)0);
+    glVertexAttribDivisor(5, 0x80000000u);
+    glEnableVertexAttribArray(5);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBufferHandle);
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    //Framebuffer
-    app->fbuffer = Framebuffer();
-    app->deferredFBuffer = Framebuffer();
-    CreateFramebuffer(app->fbuffer, app->displaySize);
-    CreateFramebuffer(app->deferredFBuffer, app->displaySize);
+    arena.vaoDirty = false;
+    return arena.vao;
+}
 
-    // Initialization program
-    app->texturedGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY");
-    Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0,3 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1,3 });
-    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2,2 });
+void CheckFramebufferStatus(Framebuffer &fb)
+{
+    fb.framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (fb.framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+    {
+        switch (fb.framebufferStatus)
+        {
+        case GL_FRAMEBUFFER_UNDEFINED: ELOG("GL_FRAMEBUFFER_UNDEFINED"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT: ELOG("GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT: ELOG("GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER: ELOG("GL_FRAMEBUFFER_INCOMPLETE_DRAW_BUFFER"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER: ELOG("GL_FRAMEBUFFER_INCOMPLETE_READ_BUFFER"); break;
+        case GL_FRAMEBUFFER_UNSUPPORTED: ELOG("GL_FRAMEBUFFER_UNSUPPORTED"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE: ELOG("GL_FRAMEBUFFER_INCOMPLETE_MULTISAMPLE"); break;
+        case GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS: ELOG("GL_FRAMEBUFFER_INCOMPLETE_LAYER_TARGETS"); break;
+        default: ELOG("Unknown framebuffer status error"); break;
+        }
+    }
+}
 
-    app->texturedGeometryProgramIdx4 = LoadProgram(app, "shadersLight.glsl", "TEXTURED_GEOMETRY");
-    Program& texturedLightProgram = app->programs[app->texturedGeometryProgramIdx4];
-    texturedLightProgram.vertexInputLayout.attributes.push_back({ 0,3 });
-    texturedLightProgram.vertexInputLayout.attributes.push_back({ 1,3 });
-    texturedLightProgram.vertexInputLayout.attributes.push_back({ 2,2 });
+void CreateFramebuffer(Framebuffer &fb, ivec2 &display)
+{
+    glGenTextures(1, &fb.colorAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.colorAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    app->entities.push_back(Entity(glm::vec3(0.0f, 0.0f, 0.0f), LoadModel(app, "Patrick/Patrick.obj")));
-    app->entities.push_back(Entity(glm::vec3(7.0f, 0.0f, 0.0f), LoadModel(app, "Patrick/Patrick.obj")));
-    app->entities.push_back(Entity(glm::vec3(-7.0f, 0.0f, 0.0f), LoadModel(app, "Patrick/Patrick.obj")));
+    glGenTextures(1, &fb.positionAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.positionAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    app->pointLightModel = LoadModel(app, "Patrick/PointLight.obj");
-    app->directionalLightModel = LoadModel(app, "Patrick/DirectionalLight.obj");
+    glGenTextures(1, &fb.normalAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.normalAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    Light light = Light();
-    light.color = glm::vec3(1.0, 1.0, 1.0);
-    light.direction = glm::normalize(glm::vec3(1.0, 0.0, 0.0));
-    light.position = glm::vec3(11.0, 0.0, 0.0);
-    light.type = LightType_Directional;
+    // Stencil is used by the light volumes of the deferred pass
+    glGenTextures(1, &fb.depthAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.depthAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, display.x, display.y, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    Light light2 = Light();
-    light2.color = glm::vec3(0.0, 0.0, 1.0);
-    light2.position = glm::vec3(0.0, 0.0, -1.0);
-    light2.type = LightType_Point;
+    glGenFramebuffers(1, &fb.framebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.framebufferHandle);
+    // Matches the outputs of the geometry shaders: color, position, normal
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, fb.colorAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, fb.positionAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, fb.normalAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, fb.depthAttachmentHandle, 0);
 
-    Light light3 = Light();
-    light3.color = glm::vec3(1.0, 0.0, 0.0);
-    light3.direction = glm::normalize(glm::vec3(-1.0, -1.0, 0.0));
-    light3.position = glm::vec3(-3.0, -3.0, -4.0);
-    light3.type = LightType_Directional;
+    CheckFramebufferStatus(fb);
 
-    Light light4 = Light();
-    light4.color = glm::vec3(0.0, 1.0, 0.0);
-    light4.position = glm::vec3(2.0, 0.0, 2.0);
-    light4.type = LightType_Point;
+    GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, drawBuffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-    Light light5 = Light();
-    light5.color = glm::vec3(0.0, 1.0, 1.0);
-    light5.position = glm::vec3(-2.0, 2.0, 2.0);
-    light5.type = LightType_Point;
+// Albedo and octahedral normal only, the lighting passes rebuild the position from depth
+void CreateCompactFramebuffer(Framebuffer &fb, ivec2 &display)
+{
+    glGenTextures(1, &fb.colorAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.colorAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, display.x, display.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    Light light6 = Light();
-    light6.color = glm::vec3(1.0, 0.3, 1.0);
-    light6.position = glm::vec3(7.0, 3.0, 2.0);
-    light6.type = LightType_Point;
+    fb.positionAttachmentHandle = 0;
+
+    glGenTextures(1, &fb.normalAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.normalAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, display.x, display.y, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &fb.depthAttachmentHandle);
+    glBindTexture(GL_TEXTURE_2D, fb.depthAttachmentHandle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, display.x, display.y, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fb.framebufferHandle);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb.framebufferHandle);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, fb.colorAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, fb.normalAttachmentHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, fb.depthAttachmentHandle, 0);
+
+    CheckFramebufferStatus(fb);
+
+    GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CreateGpuTimer(GpuTimer& timer)
+{
+    glGenQueries(GPU_TIMER_FRAMES, timer.queries);
+    timer.frame = 0;
+    timer.milliseconds = 0.0f;
+}
+
+void BeginGpuTimer(GpuTimer& timer)
+{
+    // The query about to be reused was issued GPU_TIMER_FRAMES frames ago
+    const GLuint query = timer.queries[timer.frame % GPU_TIMER_FRAMES];
+    if (timer.frame >= GPU_TIMER_FRAMES)
+    {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        timer.milliseconds = (f32)((f64)nanoseconds / 1000000.0);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void EndGpuTimer(GpuTimer& timer)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    timer.frame++;
+}
+
+// The compact layout only makes sense for the deferred pass, forward reads the lit color
+Framebuffer& GetGBuffer(App* app)
+{
+    if (app->renderMode == 1 && app->gbufferLayout == GBufferLayout_Compact)
+        return app->compactFBuffer;
+    return app->fbuffer;
+}
+
+// Keywords of the geometry programs: lit color (forward), albedo with position and normal
+// (DEFERRED) or albedo with an octahedral normal (GBUFFER_COMPACT)
+const char* GetGeometryKeywords(App* app)
+{
+    if (app->renderMode != 1)
+        return "";
+    return app->gbufferLayout == GBufferLayout_Compact ? "GBUFFER_COMPACT" : "DEFERRED";
+}
+
+// Keywords of the lighting programs, the compact layout has its position rebuilt from depth
+const char* GetLightingKeywords(App* app)
+{
+    return &GetGBuffer(app) == &app->compactFBuffer ? "GBUFFER_COMPACT" : "";
+}
+
+/**
+ * Permutation of a program for the given keywords. Programs that loop over the global
+ * lights ask for one with the light count baked in so the loop gets unrolled, it is built
+ * in the background the first time a count is seen and the generic loop is used meanwhile.
+ * Without KHR_parallel_shader_compile that would stall the frame, so the loop stays generic.
+ */
+u32 GetRenderProgram(App* app, u32 programIdx, const char* keywords, bool lightLoop)
+{
+    const u32 genericIdx = GetProgramPermutation(app, programIdx, keywords);
+    if (!lightLoop || !app->parallelShaderCompile)
+        return genericIdx;
+
+    char lightKeywords[64];
+    const u32 lightCount = glm::min((u32)app->lights.size(), (u32)MAX_FORWARD_LIGHTS);
+    sprintf_s(lightKeywords, "%s%sLIGHT_COUNT=%u", keywords, *keywords ? " " : "", lightCount);
+
+    const u32 specializedIdx = GetProgramPermutation(app, programIdx, lightKeywords);
+    return IsProgramReady(app, specializedIdx) ? specializedIdx : genericIdx;
+}
+
+// Geometry programs only loop over the lights when they shade forward
+u32 GetGeometryProgram(App* app, u32 programIdx)
+{
+    return GetRenderProgram(app, programIdx, GetGeometryKeywords(app), app->renderMode != 1);
+}
+
+u32 GetGBufferBytesPerPixel(App* app)
+{
+    // Depth and stencil are 4 bytes in both layouts
+    if (&GetGBuffer(app) == &app->compactFBuffer)
+        return 4 + 4 + 4;
+    return 3 * 8 + 4;
+}
+
+void Init(App* app)
+{
+    app->cam = Camera(glm::vec3(0.0f, 0.0f, 10.0f));
+
+    // GL INFO
+    app->glInfo.glVersion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    app->glInfo.glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    app->glInfo.glVendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+    app->glInfo.glShadingVersion = reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; ++i)
+    {
+        app->glInfo.glExtensions.push_back(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i))));
+    }
+
+    LoadGLExtensions(app->glInfo.glExtensions);
+    app->textureCodecMask = GetSupportedTextureCodecs(app->glInfo.glExtensions);
+    app->bindlessTextures = glGetTextureHandleARB != NULL;
+    app->useBindlessTextures = app->bindlessTextures;
+    app->parallelShaderCompile = glMaxShaderCompilerThreadsKHR != NULL;
+    if (app->parallelShaderCompile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many threads as the driver wants
+    InitFileWatcher(app->fileWatcher); // before any asset is loaded, loads watch their files
+    glGenBuffers(1, &app->textureTableBuffer);
+    glGenBuffers(1, &app->materialBuffer);
+
+    // TODO: Initialize your resources here!
+    // - vertex buffers
+    // - element/index buffers
+    // - vaos
+    // - programs (and retrieve uniform indices)
+    // - textures
+
+    app->mode = Mode_Model;
+
+    //if (app->mode == Mode_Model)
+    {
+
+    //glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_CULL_FACE);
+
+    //Geometry
+    // Display Buffer
+    glGenBuffers(1, &app->embeddedVertices);
+    glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &app->embeddedElements);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // Attribute state
+    glGenVertexArrays(1, &app->vao);
+    glBindVertexArray(app->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
+    glBindVertexArray(0);
+
+    //Framebuffer
+    app->fbuffer = Framebuffer();
+    app->deferredFBuffer = Framebuffer();
+    CreateFramebuffer(app->fbuffer, app->displaySize);
+    CreateFramebuffer(app->deferredFBuffer, app->displaySize);
+    CreateCompactFramebuffer(app->compactFBuffer, app->displaySize);
+    app->gbufferLayout = GBufferLayout_Regular;
+    CreateGpuTimer(app->gbufferTimer);
+    CreateGpuTimer(app->lightingTimer);
+
+    // Initialization program. Every program and G-buffer permutation is issued before any
+    // of them is queried, so the driver can compile them in parallel.
+    app->texturedGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY");
+    app->texturedMeshProgramIdx = app->texturedGeometryProgramIdx;
+    Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0,3 });
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1,3 });
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2,2 });
+
+    app->texturedMeshInstancedProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY_INSTANCED");
+    Program& texturedMeshInstancedProgram = app->programs[app->texturedMeshInstancedProgramIdx];
+    texturedMeshInstancedProgram.vertexInputLayout.attributes.push_back({ 0,3 });
+    texturedMeshInstancedProgram.vertexInputLayout.attributes.push_back({ 1,3 });
+    texturedMeshInstancedProgram.vertexInputLayout.attributes.push_back({ 2,2 });
+
+    app->texturedMeshIndirectProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY_INDIRECT");
+    app->texturedMeshIndirectBindlessProgramIdx = UINT32_MAX;
+    if (app->bindlessTextures)
+        app->texturedMeshIndirectBindlessProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY_INDIRECT_BINDLESS");
+
+    app->texturedGeometryProgramIdx4 = LoadProgram(app, "shadersLight.glsl", "TEXTURED_GEOMETRY");
+    Program& texturedLightProgram = app->programs[app->texturedGeometryProgramIdx4];
+    texturedLightProgram.vertexInputLayout.attributes.push_back({ 0,3 });
+    texturedLightProgram.vertexInputLayout.attributes.push_back({ 1,3 });
+    texturedLightProgram.vertexInputLayout.attributes.push_back({ 2,2 });
+
+    app->texturedGeometryProgramIdx2 = LoadProgram(app, "shaders2.glsl", "TEXTURED_GEOMETRY");
+    app->texturedGeometryProgramIdx3 = LoadProgram(app, "shaders3.glsl", "TEXTURED_GEOMETRY");
+    app->clusterLightsProgramIdx = LoadComputeProgram(app, "shaders3.glsl", "CLUSTER_LIGHTS");
+    app->clusteredLightingProgramIdx = LoadProgram(app, "shaders3.glsl", "CLUSTERED_LIGHTING");
+    app->directionalLightingProgramIdx = LoadProgram(app, "shaders3.glsl", "DIRECTIONAL_LIGHTING");
+    app->lightVolumeProgramIdx = LoadProgram(app, "shaders3.glsl", "LIGHT_VOLUME");
+    Program& lightVolumeProgram = app->programs[app->lightVolumeProgramIdx];
+    lightVolumeProgram.vertexInputLayout.attributes.push_back({ 0,3 });
+
+    const char* geometryKeywords[] = { "DEFERRED", "GBUFFER_COMPACT" };
+    for (u32 i = 0; i < ARRAY_COUNT(geometryKeywords); ++i)
+    {
+        GetProgramPermutation(app, app->texturedMeshProgramIdx, geometryKeywords[i]);
+        GetProgramPermutation(app, app->texturedMeshInstancedProgramIdx, geometryKeywords[i]);
+        GetProgramPermutation(app, app->texturedMeshIndirectProgramIdx, geometryKeywords[i]);
+        if (app->bindlessTextures)
+            GetProgramPermutation(app, app->texturedMeshIndirectBindlessProgramIdx, geometryKeywords[i]);
+    }
+    GetProgramPermutation(app, app->texturedGeometryProgramIdx3, "GBUFFER_COMPACT");
+    GetProgramPermutation(app, app->clusteredLightingProgramIdx, "GBUFFER_COMPACT");
+    GetProgramPermutation(app, app->directionalLightingProgramIdx, "GBUFFER_COMPACT");
+    GetProgramPermutation(app, app->lightVolumeProgramIdx, "GBUFFER_COMPACT");
+    FinishProgramCompiles(app, true);
+
+    // Initialization texture, loaded right away since they are the placeholders of the
+    // textures loaded in the background
+    app->diceTexIdx = LoadTexture2D(app, "dice.png");
+    app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
+    app->blackTexIdx = LoadTexture2D(app, "color_black.png");
+    app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
+    app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
+
+    // Models are imported on the workers and uploaded as they complete, entities can
+    // use them while they are still empty
+    InitJobSystem(app->jobSystem, 0);
+    app->meshes.push_back(Mesh{}); // EMPTY_MESH_IDX
+
+    // Entities that share a model are drawn as instances of the same batch
+    InitBvh(app->entityBvh, 0.5f);
+    u32 patrickModel = LoadModelAsync(app, "Patrick/Patrick.obj");
+    AddEntity(app, glm::vec3(0.0f, 0.0f, 0.0f), patrickModel);
+    AddEntity(app, glm::vec3(7.0f, 0.0f, 0.0f), patrickModel);
+    AddEntity(app, glm::vec3(-7.0f, 0.0f, 0.0f), patrickModel);
+
+    app->pointLightModel = LoadModelAsync(app, "Patrick/PointLight.obj");
+    app->directionalLightModel = LoadModelAsync(app, "Patrick/DirectionalLight.obj");
+
+    Light light = Light();
+    light.color = glm::vec3(1.0, 1.0, 1.0);
+    light.direction = glm::normalize(glm::vec3(1.0, 0.0, 0.0));
+    light.position = glm::vec3(11.0, 0.0, 0.0);
+    light.type = LightType_Directional;
+
+    Light light2 = Light();
+    light2.color = glm::vec3(0.0, 0.0, 1.0);
+    light2.position = glm::vec3(0.0, 0.0, -1.0);
+    light2.type = LightType_Point;
+
+    Light light3 = Light();
+    light3.color = glm::vec3(1.0, 0.0, 0.0);
+    light3.direction = glm::normalize(glm::vec3(-1.0, -1.0, 0.0));
+    light3.position = glm::vec3(-3.0, -3.0, -4.0);
+    light3.type = LightType_Directional;
+
+    Light light4 = Light();
+    light4.color = glm::vec3(0.0, 1.0, 0.0);
+    light4.position = glm::vec3(2.0, 0.0, 2.0);
+    light4.type = LightType_Point;
+
+    Light light5 = Light();
+    light5.color = glm::vec3(0.0, 1.0, 1.0);
+    light5.position = glm::vec3(-2.0, 2.0, 2.0);
+    light5.type = LightType_Point;
+
+    Light light6 = Light();
+    light6.color = glm::vec3(1.0, 0.3, 1.0);
+    light6.position = glm::vec3(7.0, 3.0, 2.0);
+    light6.type = LightType_Point;
+
+    Light light7 = Light();
+    light7.color = glm::vec3(1.0, 1.0, 0.0);
+    light7.position = glm::vec3(-7.0, -2.0, 2.0);
+    light7.type = LightType_Point;
+
+    app->lights.push_back(light);
+    app->lights.push_back(light2);
+    app->lights.push_back(light3);
+    app->lights.push_back(light4);
+    app->lights.push_back(light5);
+    app->lights.push_back(light6);
+    app->lights.push_back(light7);
+
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAligment);
+
+    const u32 uniformRegionSize = Align(app->maxUniformBufferSize, app->uniformBlockAligment);
+    app->bufferGlobals = CreateRingBuffer(uniformRegionSize, RING_BUFFER_FRAME_COUNT, GL_UNIFORM_BUFFER);
+
+    app->textureUploadBuffer = CreateRingBuffer(TEXTURE_STREAM_BUDGET, RING_BUFFER_FRAME_COUNT, GL_PIXEL_UNPACK_BUFFER);
+    app->textureStreamBudget = TEXTURE_STREAM_BUDGET;
+
+    // Every entity block is bound on its own, so pages can be bigger than the max uniform
+    // block size. More pages get chained when the entity count needs them.
+    app->buffer = CreatePagedBuffer(Align(MB(1), app->uniformBlockAligment), GL_UNIFORM_BUFFER);
+
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &app->storageBlockAlignment);
+    app->instanceBuffer = CreatePagedBuffer(Align(MB(4), app->storageBlockAlignment), GL_SHADER_STORAGE_BUFFER);
+
+    app->indirectCommandBuffer = CreateRingBuffer(KB(64), RING_BUFFER_FRAME_COUNT, GL_DRAW_INDIRECT_BUFFER);
+    app->indirectDrawParamsBuffer = CreateRingBuffer(Align(KB(64), app->storageBlockAlignment), RING_BUFFER_FRAME_COUNT, GL_SHADER_STORAGE_BUFFER);
+    app->indirectInstanceBuffer = CreateRingBuffer(Align(MB(1), app->storageBlockAlignment), RING_BUFFER_FRAME_COUNT, GL_SHADER_STORAGE_BUFFER);
+
+    // The light list is written by the CPU every frame, the cluster grid and the light
+    // indices are only written by the light assignment compute pass
+    const u32 lightBufferSize = Align(4 * sizeof(u32) + MAX_CLUSTERED_LIGHTS * sizeof(GpuLight), app->storageBlockAlignment);
+    app->lightBuffer = CreateRingBuffer(lightBufferSize, RING_BUFFER_FRAME_COUNT, GL_SHADER_STORAGE_BUFFER);
+
+    glGenBuffers(1, &app->clusterGridBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->clusterGridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * 2 * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &app->clusterLightIndexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->clusterLightIndexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (1 + CLUSTER_MAX_LIGHT_INDICES) * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    app->deferredLighting = DeferredLighting_Clustered;
+    app->entityRenderPath = EntityRenderPath_Indirect;
+    app->frustumCulling = true;
+    app->bvhCulling = true;
+    app->meshletCulling = true;
+    app->lodErrorPixels = 1.0f;
+    app->lodBias = 0;
+    app->orbitReference = vec3(0.0f);
+    app->pickedEntityIdx = BVH_NULL_NODE;
+    app->bvhBenchmark = {};
+
+    }
+    //else
+    {
+        glGenBuffers(1, &app->embeddedVertices2);
+        glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices2);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &app->embeddedElements2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements2);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        glGenVertexArrays(1, &app->vao2);
+        glBindVertexArray(app->vao2);
+        glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices2);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements2);
+        glBindVertexArray(0);
+    }
+
+    /*glGenBuffers(1, &app->buffer.handle);
+    glBindBuffer(GL_UNIFORM_BUFFER, app->buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, app->maxUniformBufferSize, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);*/
+}
+
+void AddRandomPointLights(App* app, u32 count)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        Light light = Light();
+        light.type = LightType_Point;
+        light.color = glm::vec3(rand() % 256, rand() % 256, rand() % 256) / 255.0f * 0.1f;
+        light.position = glm::vec3(rand() % 4001 - 2000, rand() % 1001 - 500, rand() % 4001 - 2000) / 100.0f;
+        app->lights.push_back(light);
+    }
+}
+
+void Gui(App* app)
+{
+    //ImGui::DockSpaceOverViewport();
+
+    if (ImGui::BeginMainMenuBar())
+    {
+        if (ImGui::BeginMenu("Render Mode"))
+        {
+            const char* modes[] = { "Forward", "Deferred" };
+            int currentMode = app->renderMode;
+
+            ImGui::Text("Select Render:");
+
+            if (ImGui::Combo("##combo", &currentMode, modes, 2))
+            {
+                app->renderMode = currentMode;
+            }
+
+            const char* gbufferLayouts[] = { "Regular (RGBA16F)", "Compact (RGBA8 + RG16 octahedral)" };
+            int currentLayout = app->gbufferLayout;
+
+            ImGui::Text("G-buffer layout:");
+
+            if (ImGui::Combo("##gbufferLayout", &currentLayout, gbufferLayouts, GBufferLayout_Count))
+            {
+                app->gbufferLayout = (GBufferLayout)currentLayout;
+            }
+
+            const char* lightingModes[] = { "Full screen", "Clustered", "Light volumes" };
+            int currentLighting = app->deferredLighting;
+
+            ImGui::Text("Deferred lighting:");
+
+            if (ImGui::Combo("##deferredLighting", &currentLighting, lightingModes, DeferredLighting_Count))
+            {
+                app->deferredLighting = (DeferredLighting)currentLighting;
+            }
+
+            const char* entityPaths[] = { "Per entity", "Instanced", "Multi-draw indirect" };
+            int currentPath = app->entityRenderPath;
+
+            ImGui::Text("Entity submission:");
+
+            if (ImGui::Combo("##entityPath", &currentPath, entityPaths, EntityRenderPath_Count))
+            {
+                app->entityRenderPath = (EntityRenderPath)currentPath;
+            }
+
+            ImGui::EndMenu();
+        }
+
+        if (ImGui::BeginMenu("Render target"))
+        {
+            const char* renders[] = { "Albedo", "Normals" , "Position", "Depth" };
+            int currentRender = app->renderTarget;
+
+            ImGui::Text("Select Mode:");
+
+            if (ImGui::Combo("##combo", &currentRender, renders, 4))
+            {
+                app->renderTarget = currentRender;
+            }
+
+            ImGui::EndMenu();
+        }
+
+        ImGui::EndMainMenuBar();
+    }
+
+    ImGui::Begin("Info");
+    ImGui::Text("FPS: %f", 1.0f / app->deltaTime);
+    if (app->jobSystem.pendingCount > 0)
+        ImGui::Text("Loading assets: %u", app->jobSystem.pendingCount);
+    ImGui::Text("Texture uploads: %.2f MB this frame, %u textures streaming", app->textureUploadBytes / (1024.0f * 1024.0f),
+        (u32)app->textureStreamRequests.size());
+    for (u32 i = 0; i < TextureCodec_Count; ++i)
+        if (app->textureBytes[i] > 0)
+            ImGui::Text("Textures %s: %.2f MB", GetTextureCodecName((TextureCodec)i), app->textureBytes[i] / (1024.0f * 1024.0f));
+    ImGui::Text("Texture arrays: %.2f MB in %u arrays", app->textureArrayBytes / (1024.0f * 1024.0f), (u32)app->textureArrays.size());
+    ImGui::Text("Assets: %u models, %u meshes, %u textures", app->assets.counts[AssetType_Model],
+        app->assets.counts[AssetType_Mesh], app->assets.counts[AssetType_Texture]);
+    u32 uniformStalls = app->bufferGlobals.stallCount;
+    for (u32 i = 0; i < app->buffer.pages.size(); ++i)
+        uniformStalls += app->buffer.pages[i].stallCount;
+    ImGui::Text("Uniform ring stalls: %u", uniformStalls);
+    ImGui::Text("Entity uniform pages: %u", (u32)app->buffer.pages.size());
+    ImGui::Checkbox("Frustum culling", &app->frustumCulling);
+    ImGui::Checkbox("Cull with BVH", &app->bvhCulling);
+    ImGui::Text("BVH nodes: %u (height %d)", (u32)app->entityBvh.nodes.size(),
+        app->entityBvh.root != BVH_NULL_NODE ? app->entityBvh.nodes[app->entityBvh.root].height : 0);
+    if (app->pickedEntityIdx != BVH_NULL_NODE)
+        ImGui::Text("Picked entity: %u", app->pickedEntityIdx);
+    for (u32 i = 0; i < app->lightEntityCounts.size(); ++i)
+        if (app->lights[i].type == LightType_Point)
+            ImGui::Text("Point light %u reaches %u entities", i, app->lightEntityCounts[i]);
+    const u32 gbufferBytesPerPixel = GetGBufferBytesPerPixel(app);
+    const f32 gbufferMegabytes = (f32)gbufferBytesPerPixel * app->displaySize.x * app->displaySize.y / (1024.0f * 1024.0f);
+    ImGui::Text("G-buffer: %u bytes/pixel, %.1f MB per frame", gbufferBytesPerPixel, gbufferMegabytes);
+    ImGui::Text("G-buffer pass: %.3f ms", app->gbufferTimer.milliseconds);
+    if (app->renderMode == 1)
+        ImGui::Text("Lighting pass: %.3f ms", app->lightingTimer.milliseconds);
+    ImGui::Text("Lights: %u", (u32)app->lights.size());
+    if (ImGui::Button("Add 256 point lights"))
+        AddRandomPointLights(app, 256);
+    if (app->lights.size() > MAX_FORWARD_LIGHTS && !(app->renderMode == 1 && app->deferredLighting == DeferredLighting_Clustered))
+        ImGui::Text("Only the first %u lights are used without clustered lighting", MAX_FORWARD_LIGHTS);
+    if (app->renderMode == 1 && app->deferredLighting == DeferredLighting_LightVolumes)
+        ImGui::Text("Light volumes: %u", app->lightVolumeCount);
+    if (ImGui::Button("Run BVH benchmark"))
+        app->bvhBenchmark = RunBvhBenchmark(100000, 64);
+    if (app->bvhBenchmark.objectCount > 0)
+        ImGui::Text("%u boxes: linear %.3f ms, BVH %.3f ms", app->bvhBenchmark.objectCount, app->bvhBenchmark.linearMs, app->bvhBenchmark.bvhMs);
+    ImGui::Text("Visible entities: %u", app->visibleEntityCount);
+    ImGui::Text("Culled entities: %u", (u32)app->entities.size() - app->visibleEntityCount);
+    if (app->entityRenderPath == EntityRenderPath_PerEntity)
+        ImGui::Text("Culled submeshes: %u", app->culledSubmeshCount);
+    if (app->entityRenderPath == EntityRenderPath_PerEntity)
+    {
+        ImGui::Checkbox("Cull meshlets", &app->meshletCulling);
+        ImGui::Text("Culled meshlets: %u of %u", app->culledMeshletCount, app->testedMeshletCount);
+    }
+    ImGui::SliderFloat("LOD error (pixels)", &app->lodErrorPixels, 0.25f, 16.0f);
+    ImGui::SliderInt("LOD bias", &app->lodBias, 1 - MESH_MAX_LODS, MESH_MAX_LODS - 1);
+    ImGui::Text("Entities per LOD: %u, %u, %u, %u", app->lodEntityCounts[0], app->lodEntityCounts[1],
+        app->lodEntityCounts[2], app->lodEntityCounts[3]);
+
+    if (app->entityRenderPath == EntityRenderPath_PerEntity)
+    {
+        const RenderQueueStats& stats = app->renderQueue.stats;
+        ImGui::Text("Draw calls: %u", stats.drawCalls);
+        ImGui::Text("Program binds: %u (%u skipped)", stats.programBinds, stats.skippedProgramBinds);
+        ImGui::Text("VAO binds: %u (%u skipped)", stats.vaoBinds, stats.skippedVaoBinds);
+        ImGui::Text("Texture binds: %u (%u skipped)", stats.textureBinds, stats.skippedTextureBinds);
+        ImGui::Text("Uniform binds: %u (%u skipped)", stats.uniformBinds, stats.skippedUniformBinds);
+    }
+    if (app->entityRenderPath == EntityRenderPath_Instanced)
+        ImGui::Text("Instance batches: %u", (u32)app->instanceBatches.size());
+    if (app->entityRenderPath == EntityRenderPath_Indirect)
+    {
+        ImGui::Text("Indirect commands: %u in %u multi-draws", (u32)app->indirectDraws.size(), (u32)app->indirectBuckets.size());
+        ImGui::Text("Texture arrays: %u", (u32)app->textureArrays.size());
+        if (app->bindlessTextures)
+            ImGui::Checkbox("Bindless textures", &app->useBindlessTextures);
+    }
+    ImGui::End();
+
+    ImGui::Begin("OpenGL Info");
+    ImGui::Text("Version: %s", app->glInfo.glVersion.c_str());
+    ImGui::Text("Renderer: %s", app->glInfo.glRenderer.c_str());
+    ImGui::Text("Vendor: %s", app->glInfo.glVendor.c_str());
+    ImGui::Text("GLSL Version: %s", app->glInfo.glShadingVersion.c_str());
+
+    ImGui::Separator();
+    ImGui::Text("Extensions");
+    for (size_t i = 0; i < app->glInfo.glExtensions.size(); ++i)
+    {
+        ImGui::Text("%s", app->glInfo.glVersion.c_str());
+    }
+
+    ImGui::End();
+}
+
+Aabb GetEntityAabb(App* app, const Entity& entity)
+{
+    const Mesh& mesh = app->meshes[app->models[entity.modelIdx].meshIdx];
+    Aabb aabb;
+    aabb.min = mesh.aabb.min + entity.pos;
+    aabb.max = mesh.aabb.max + entity.pos;
+    return aabb;
+}
+
+u32 AddEntity(App* app, const glm::vec3& position, u32 modelIdx)
+{
+    const u32 entityIdx = (u32)app->entities.size();
+    app->entities.push_back(Entity(position, modelIdx));
+
+    Entity& entity = app->entities.back();
+    entity.bvhProxy = BvhInsert(app->entityBvh, GetEntityAabb(app, entity), entityIdx);
+    return entityIdx;
+}
+
+void MoveEntity(App* app, u32 entityIdx, const glm::vec3& position)
+{
+    Entity& entity = app->entities[entityIdx];
+    entity.pos = position;
+    BvhMove(app->entityBvh, entity.bvhProxy, GetEntityAabb(app, entity));
+}
+
+// Exact test against the entity bounds, the tree only stores the fat ones
+static f32 RayEntityDistance(void* context, u32 entityIdx, const glm::vec3& origin, const glm::vec3& direction)
+{
+    App* app = (App*)context;
+    return RayAabbDistance(origin, 1.0f / direction, GetEntityAabb(app, app->entities[entityIdx]));
+}
+
+// Returns the entity under the cursor, or BVH_NULL_NODE if there is none
+u32 PickEntity(App* app, const glm::vec2& mousePos)
+{
+    const glm::vec2 ndc(
+        2.0f * mousePos.x / (f32)app->displaySize.x - 1.0f,
+        1.0f - 2.0f * mousePos.y / (f32)app->displaySize.y);
+
+    const glm::mat4 inverseViewProjection = glm::inverse(app->cam.GetProjectionMatrix() * app->cam.GetViewMatrix());
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+
+    const glm::vec3 origin(nearPoint);
+    const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) - origin);
+
+    f32 distance;
+    return BvhRaycast(app->entityBvh, origin, direction, RayEntityDistance, app, distance);
+}
+
+// Distance at which the 2/d^2 attenuation of the shaders drops below 1/256
+f32 GetPointLightRadius(const Light& light)
+{
+    const f32 intensity = glm::max(light.color.r, glm::max(light.color.g, light.color.b));
+    return sqrtf(2.0f * 256.0f * intensity);
+}
+
+void UpdateLightEntityOverlaps(App* app)
+{
+    app->lightEntityCounts.resize(app->lights.size());
+    for (u32 i = 0; i < app->lights.size(); ++i)
+    {
+        const Light& light = app->lights[i];
+        if (light.type != LightType_Point)
+        {
+            app->lightEntityCounts[i] = (u32)app->entities.size();
+            continue;
+        }
+
+        app->bvhResults.clear();
+        BvhQuerySphere(app->entityBvh, light.position, GetPointLightRadius(light), app->bvhResults);
+        app->lightEntityCounts[i] = (u32)app->bvhResults.size();
+    }
+}
+
+// Writes the lights for the clustered pass, directional lights first so the cluster
+// assignment only has to walk the point lights
+void PushClusteredLights(App* app)
+{
+    BeginRingBufferFrame(app->lightBuffer);
+    app->lightBufferOffset = app->lightBuffer.head;
+
+    const u32 lightCount = glm::min((u32)app->lights.size(), (u32)MAX_CLUSTERED_LIGHTS);
+    u32 directionalLightCount = 0;
+    for (u32 i = 0; i < lightCount; ++i)
+        directionalLightCount += app->lights[i].type == LightType_Directional ? 1 : 0;
+
+    PushUInt(app->lightBuffer, lightCount);
+    PushUInt(app->lightBuffer, directionalLightCount);
+
+    for (u32 pass = 0; pass < 2; ++pass)
+    {
+        const LightType type = pass == 0 ? LightType_Directional : LightType_Point;
+        for (u32 i = 0; i < lightCount; ++i)
+        {
+            const Light& light = app->lights[i];
+            if (light.type != type)
+                continue;
+
+            GpuLight gpuLight = {};
+            gpuLight.color = light.color;
+            gpuLight.type = light.type;
+            gpuLight.direction = light.direction;
+            gpuLight.radius = light.type == LightType_Point ? GetPointLightRadius(light) : 0.0f;
+            gpuLight.position = light.position;
+            PushAlignedData(app->lightBuffer, &gpuLight, sizeof(gpuLight), sizeof(vec4));
+        }
+    }
+
+    app->lightBufferSize = app->lightBuffer.head - app->lightBufferOffset;
+    EndRingBufferFrame(app->lightBuffer);
+}
+
+// Bins the point lights into the froxels of the current camera
+void AssignLightsToClusters(App* app)
+{
+    Program& clusterLightsProgram = app->programs[app->clusterLightsProgramIdx];
+    glUseProgram(clusterLightsProgram.handle);
+
+    const glm::mat4 inverseProjection = glm::inverse(app->cam.GetProjectionMatrix());
+    const glm::mat4 view = app->cam.GetViewMatrix();
+    glUniformMatrix4fv(glGetUniformLocation(clusterLightsProgram.handle, "uInverseProjection"), 1, GL_FALSE, glm::value_ptr(inverseProjection));
+    glUniformMatrix4fv(glGetUniformLocation(clusterLightsProgram.handle, "uView"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniform1f(glGetUniformLocation(clusterLightsProgram.handle, "uNear"), NEAR_PLANE);
+    glUniform1f(glGetUniformLocation(clusterLightsProgram.handle, "uFar"), FAR_PLANE);
+    glUniform1ui(glGetUniformLocation(clusterLightsProgram.handle, "uMaxLightIndices"), CLUSTER_MAX_LIGHT_INDICES);
+
+    // Reset the index counter, the first u32 of the index buffer
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->clusterLightIndexBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(u32), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, app->lightBuffer.handle, app->lightBufferOffset, app->lightBufferSize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, app->clusterGridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, app->clusterLightIndexBuffer);
+
+    glDispatchCompute(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(0);
+}
+
+// Tests the bounding sphere of every entity against the camera frustum, four at a time,
+// or walks the BVH so whole subtrees are accepted or rejected with a single test
+void UpdateEntityVisibility(App* app, const glm::mat4& viewProjection)
+{
+    const u32 entityCount = (u32)app->entities.size();
+    app->entityVisible.resize(entityCount);
+    app->frustum = ExtractFrustum(viewProjection);
+
+    if (!app->frustumCulling)
+    {
+        std::fill(app->entityVisible.begin(), app->entityVisible.end(), 1);
+        app->visibleEntityCount = entityCount;
+        return;
+    }
+
+    if (app->bvhCulling)
+    {
+        std::fill(app->entityVisible.begin(), app->entityVisible.end(), 0);
+        app->bvhResults.clear();
+        BvhQueryFrustum(app->entityBvh, app->frustum, app->bvhResults);
+        for (u32 i = 0; i < app->bvhResults.size(); ++i)
+            app->entityVisible[app->bvhResults[i]] = 1;
+        app->visibleEntityCount = (u32)app->bvhResults.size();
+        return;
+    }
+
+    ResizeSphereSoA(app->entitySpheres, entityCount);
+    for (u32 i = 0; i < entityCount; ++i)
+    {
+        const Entity& entity = app->entities[i];
+        const Mesh& mesh = app->meshes[app->models[entity.modelIdx].meshIdx];
+        SetSphere(app->entitySpheres, i, entity.pos + mesh.sphere.center, mesh.sphere.radius);
+    }
+
+    app->visibleEntityCount = CullSpheres(app->frustum, app->entitySpheres, app->entityVisible.data());
+}
+
+// Picks the level of every visible entity from the screen size of its LOD errors: an error
+// e at distance d covers e * pixelsPerUnit / d pixels. The distance is taken to the
+// bounding sphere so the whole entity is at least as detailed as required.
+void SelectEntityLods(App* app)
+{
+    const u32 entityCount = (u32)app->entities.size();
+    app->entityLod.resize(entityCount);
+    for (u32 l = 0; l < MESH_MAX_LODS; ++l)
+        app->lodEntityCounts[l] = 0;
+
+    const f32 pixelsPerUnit = app->cam.GetProjectionMatrix()[1][1] * app->displaySize.y * 0.5f;
+
+    for (u32 e = 0; e < entityCount; ++e)
+    {
+        if (!app->entityVisible[e])
+            continue;
+
+        const Entity& entity = app->entities[e];
+        const Mesh& mesh = app->meshes[app->models[entity.modelIdx].meshIdx];
+        const f32 distance = glm::max(glm::length(entity.pos + mesh.sphere.center - app->cam.Position) - mesh.sphere.radius, NEAR_PLANE);
+
+        u32 lod = 0;
+        while (lod + 1 < mesh.lodCount && mesh.lodErrors[lod + 1] * pixelsPerUnit / distance <= app->lodErrorPixels)
+            lod++;
+
+        const i32 maxLod = (i32)glm::max(mesh.lodCount, 1u) - 1;
+        lod = (u32)glm::clamp((i32)lod + app->lodBias, 0, maxLod);
+
+        app->entityLod[e] = (u8)lod;
+        app->lodEntityCounts[lod]++;
+    }
+}
+
+// Submeshes with fewer levels than the entity wants draw their last one
+const SubmeshLod& GetSubmeshLod(const Submesh& submesh, u32 lod)
+{
+    return submesh.lods[glm::min(lod, submesh.lodCount - 1)];
+}
+
+// Byte offset of the first index of a LOD in the mesh index buffer
+void* GetSubmeshLodIndexOffset(const Submesh& submesh, const SubmeshLod& lod)
+{
+    return (void*)(u64)(submesh.indexOffset + lod.firstIndex * GetIndexSize(submesh.indexType));
+}
+
+void PushEntityParams(App* app, const glm::mat4& viewProjection)
+{
+    BeginPagedBufferFrame(app->buffer);
+
+    const u32 localParamsSize = 2 * sizeof(glm::mat4);
+
+    for (std::vector<Entity>::iterator it = app->entities.begin(); it < app->entities.end(); ++it)
+    {
+        if (!app->entityVisible[it - app->entities.begin()])
+            continue;
+
+        const Mesh& mesh = app->meshes[app->models[(*it).modelIdx].meshIdx];
+        glm::mat4 worldMatrix = glm::translate((*it).pos) * GetMeshDequantization(mesh);
+       // worldMatrix = glm::scale(worldMatrix, glm::vec3(0.9));
+        glm::mat4 worldViewProjection = viewProjection * worldMatrix;
+
+        RingBuffer& page = AllocPagedBlock(app->buffer, localParamsSize, app->uniformBlockAligment, (*it).localParamsPage, (*it).localParamsOffset);
+
+        PushMat4(page, worldMatrix);
+
+        PushMat4(page, worldViewProjection);
+
+        (*it).localParamsSize = page.head - (*it).localParamsOffset;
+    }
+
+    EndPagedBufferFrame(app->buffer);
+}
+
+// Tests the meshlets of a submesh against the frustum and their normal cones against the
+// camera, and appends the index ranges of the ones left to the item. Consecutive visible
+// meshlets are contiguous in the index buffer and become a single range.
+void CullMeshlets(App* app, const Entity& entity, const Submesh& submesh, RenderItem& item)
+{
+    const u32 indexSize = GetIndexSize(submesh.indexType);
+    item.firstRange = (u32)app->meshletRangeCounts.size();
+    item.rangeCount = 0;
+
+    u32 rangeEnd = UINT32_MAX;
+    for (u32 m = 0; m < submesh.meshlets.size(); ++m)
+    {
+        const Meshlet& meshlet = submesh.meshlets[m];
+        const glm::vec3 center = entity.pos + meshlet.sphere.center;
+        app->testedMeshletCount++;
+
+        if (!IsSphereVisible(app->frustum, center, meshlet.sphere.radius) || IsMeshletBackfacing(meshlet, center, app->cam.Position))
+        {
+            app->culledMeshletCount++;
+            continue;
+        }
+
+        if (meshlet.firstIndex == rangeEnd)
+        {
+            app->meshletRangeCounts.back() += meshlet.indexCount;
+        }
+        else
+        {
+            app->meshletRangeCounts.push_back(meshlet.indexCount);
+            app->meshletRangeOffsets.push_back((void*)(u64)(submesh.indexOffset + meshlet.firstIndex * indexSize));
+            item.rangeCount++;
+        }
+        rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+    }
+}
+
+// Emits one item per submesh of every entity and sorts them by state, so Render() can
+// skip the program/VAO/texture/uniform binds that are the same as the previous draw.
+void BuildRenderQueue(App* app)
+{
+    RenderQueue& queue = app->renderQueue;
+    queue.items.clear();
+
+    const u32 texturedMeshProgramIdx = GetGeometryProgram(app, app->texturedMeshProgramIdx);
+    const Program& texturedMeshProgram = app->programs[texturedMeshProgramIdx];
+
+    app->culledSubmeshCount = 0;
+    app->testedMeshletCount = 0;
+    app->culledMeshletCount = 0;
+    app->meshletRangeCounts.clear();
+    app->meshletRangeOffsets.clear();
+
+    for (u32 e = 0; e < app->entities.size(); ++e)
+    {
+        if (!app->entityVisible[e])
+            continue;
+
+        const Entity& entity = app->entities[e];
+        Model& model = app->models[entity.modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+
+        // The entity sphere already passed, only split meshes are worth a finer test
+        const bool testSubmeshes = app->frustumCulling && mesh.submeshes.size() > 1;
+
+        const f32 viewDepth = glm::dot(entity.pos - app->cam.Position, app->cam.Front);
+        const f32 depth01 = (viewDepth - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE);
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            if (testSubmeshes)
+            {
+                const Aabb worldAabb = { mesh.submeshes[i].aabb.min + entity.pos, mesh.submeshes[i].aabb.max + entity.pos };
+                if (!IsAabbVisible(app->frustum, worldAabb))
+                {
+                    app->culledSubmeshCount++;
+                    continue;
+                }
+            }
+
+            RenderItem item = {};
+            if (app->meshletCulling && app->entityLod[e] == 0 && !mesh.submeshes[i].meshlets.empty())
+            {
+                CullMeshlets(app, entity, mesh.submeshes[i], item);
+                if (item.rangeCount == 0)
+                {
+                    app->culledSubmeshCount++;
+                    continue;
+                }
+            }
+
+            const GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
+            const u32 textureIdx = app->materials[model.materialIdx[i]].albedoTextureIdx;
+
+            item.key = MakeRenderSortKey(texturedMeshProgramIdx, vao, textureIdx, depth01);
+            item.entityIdx = e;
+            item.submeshIdx = i;
+            queue.items.push_back(item);
+        }
+    }
 
-    Light light7 = Light();
-    light7.color = glm::vec3(1.0, 1.0, 0.0);
-    light7.position = glm::vec3(-7.0, -2.0, 2.0);
-    light7.type = LightType_Point;
+    SortRenderQueue(queue);
+}
 
-    app->lights.push_back(light);
-    app->lights.push_back(light2);
-    app->lights.push_back(light3);
-    app->lights.push_back(light4);
-    app->lights.push_back(light5);
-    app->lights.push_back(light6);
-    app->lights.push_back(light7);
+// Groups the visible entities by model and LOD with a counting sort, so there are no
+// per-frame allocations once the scratch vectors have grown. The entities of model m at
+// LOD l end up in instanceEntityOrder[instanceModelStart[g]..instanceModelStart[g + 1]),
+// with g = m * MESH_MAX_LODS + l.
+void SortEntitiesByModel(App* app)
+{
+    const u32 groupCount = (u32)app->models.size() * MESH_MAX_LODS;
+    const u32 entityCount = (u32)app->entities.size();
+
+    app->instanceModelStart.assign(groupCount + 1, 0);
+    app->instanceEntityOrder.resize(app->visibleEntityCount);
+
+    for (u32 i = 0; i < entityCount; ++i)
+        if (app->entityVisible[i])
+            app->instanceModelStart[app->entities[i].modelIdx * MESH_MAX_LODS + app->entityLod[i] + 1]++;
+    for (u32 g = 0; g < groupCount; ++g)
+        app->instanceModelStart[g + 1] += app->instanceModelStart[g];
+    for (u32 i = 0; i < entityCount; ++i)
+        if (app->entityVisible[i])
+            app->instanceEntityOrder[app->instanceModelStart[app->entities[i].modelIdx * MESH_MAX_LODS + app->entityLod[i]]++] = i;
+
+    // The scatter left every start at the beginning of the next group, shift them back
+    for (u32 g = groupCount; g > 0; --g)
+        app->instanceModelStart[g] = app->instanceModelStart[g - 1];
+    app->instanceModelStart[0] = 0;
+}
 
-    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
-    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAligment);
+// Pushes one contiguous block of instance data per batch of entities sharing a model and LOD
+void PushInstanceParams(App* app, const glm::mat4& viewProjection)
+{
+    const u32 groupCount = (u32)app->models.size() * MESH_MAX_LODS;
 
-    app->buffer = CreateConstantBuffer(app->maxUniformBufferSize);
-    app->bufferGlobals = CreateConstantBuffer(app->maxUniformBufferSize);
+    SortEntitiesByModel(app);
 
-    }
-    //else
-    {
-        glGenBuffers(1, &app->embeddedVertices2);
-        glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices2);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    app->instanceBatches.clear();
+    BeginPagedBufferFrame(app->instanceBuffer);
 
-        glGenBuffers(1, &app->embeddedElements2);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements2);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    const u32 instanceSize = 2 * sizeof(glm::mat4);
+    const u32 maxInstancesPerBatch = app->instanceBuffer.pageSize / instanceSize;
 
-        glGenVertexArrays(1, &app->vao2);
-        glBindVertexArray(app->vao2);
-        glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices2);
+    for (u32 g = 0; g < groupCount; ++g)
+    {
+        u32 first = app->instanceModelStart[g];
+        const u32 last = app->instanceModelStart[g + 1];
+        if (first == last)
+            continue;
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+        const u32 m = g / MESH_MAX_LODS;
+        const glm::mat4 dequantization = GetMeshDequantization(app->meshes[app->models[m].meshIdx]);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements2);
-        glBindVertexArray(0);
+        while (first < last)
+        {
+            InstanceBatch batch = {};
+            batch.modelIdx = m;
+            batch.lod = g % MESH_MAX_LODS;
+            batch.instanceCount = glm::min(last - first, maxInstancesPerBatch);
 
-        app->texturedGeometryProgramIdx2 = LoadProgram(app, "shaders2.glsl", "TEXTURED_GEOMETRY");
-        Program& texturedGeometryProgram2 = app->programs[app->texturedGeometryProgramIdx2];
-        app->programUniformTexture = glGetUniformLocation(texturedGeometryProgram2.handle, "uTexture");
+            RingBuffer& page = AllocPagedBlock(app->instanceBuffer, batch.instanceCount * instanceSize, app->storageBlockAlignment,
+                batch.instanceParamsPage, batch.instanceParamsOffset);
 
-        app->texturedGeometryProgramIdx3 = LoadProgram(app, "shaders3.glsl", "TEXTURED_GEOMETRY");
-    }
+            for (u32 i = first; i < first + batch.instanceCount; ++i)
+            {
+                const Entity& entity = app->entities[app->instanceEntityOrder[i]];
+                glm::mat4 worldMatrix = glm::translate(entity.pos) * dequantization;
+                glm::mat4 worldViewProjection = viewProjection * worldMatrix;
 
-    // Initialization texture
-    app->diceTexIdx = LoadTexture2D(app, "dice.png");
-    app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
-    app->blackTexIdx = LoadTexture2D(app, "color_black.png");
-    app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
-    app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
+                PushMat4(page, worldMatrix);
+                PushMat4(page, worldViewProjection);
+            }
 
-    // GL INFO
-    app->glInfo.glVersion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
-    app->glInfo.glRenderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
-    app->glInfo.glVendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
-    app->glInfo.glShadingVersion = reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION));
+            batch.instanceParamsSize = page.head - batch.instanceParamsOffset;
+            app->instanceBatches.push_back(batch);
 
-    GLint numExtensions = 0;
-    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
-    for (GLint i = 0; i < numExtensions; ++i)
-    {
-        app->glInfo.glExtensions.push_back(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i))));
+            first += batch.instanceCount;
+        }
     }
 
-    /*glGenBuffers(1, &app->buffer.handle);
-    glBindBuffer(GL_UNIFORM_BUFFER, app->buffer.handle);
-    glBufferData(GL_UNIFORM_BUFFER, app->maxUniformBufferSize, NULL, GL_STREAM_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);*/
+    EndPagedBufferFrame(app->instanceBuffer);
 }
 
-void Gui(App* app)
+bool CompareIndirectDraws(const IndirectDraw& a, const IndirectDraw& b)
 {
-    //ImGui::DockSpaceOverViewport();
+    return a.textureArrayIdx < b.textureArrayIdx;
+}
 
-    if (ImGui::BeginMainMenuBar())
+// Builds the commands of the multi-draw path: every instance is written once into a
+// single storage block, and every (model, LOD, submesh) triple becomes one command
+// covering all the instances of the model at that LOD. The shader reads the material of
+// the draw from the material table and finds its albedo layer through the texture table,
+// so commands are only sorted by texture array: each array is
+// bound once and its commands go out in a single multi-draw. With bindless textures there
+// is nothing to bind and every command goes out in one multi-draw.
+void PushIndirectDraws(App* app, const glm::mat4& viewProjection)
+{
+    SortEntitiesByModel(app);
+
+    const u32 groupCount = (u32)app->models.size() * MESH_MAX_LODS;
+    const u32 instanceSize = 2 * sizeof(glm::mat4);
+
+    app->indirectDraws.clear();
+    for (u32 g = 0; g < groupCount; ++g)
     {
-        if (ImGui::BeginMenu("Render Mode"))
+        const u32 firstInstance = app->instanceModelStart[g];
+        const u32 instanceCount = app->instanceModelStart[g + 1] - firstInstance;
+        if (instanceCount == 0)
+            continue;
+
+        Model& model = app->models[g / MESH_MAX_LODS];
+        Mesh& mesh = app->meshes[model.meshIdx];
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
         {
-            const char* modes[] = { "Forward", "Deferred" };
-            int currentMode = app->renderMode;
+            const Submesh& submesh = mesh.submeshes[i];
+            const SubmeshLod& lod = GetSubmeshLod(submesh, g % MESH_MAX_LODS);
+
+            IndirectDraw draw = {};
+            const u32 textureIdx = app->materials[model.materialIdx[i]].albedoTextureIdx;
+            draw.textureArrayIdx = app->useBindlessTextures ? 0 : app->textures[textureIdx].arrayIdx;
+            draw.command.count = lod.indexCount;
+            draw.command.instanceCount = instanceCount;
+            draw.command.firstIndex = submesh.arenaFirstIndex + lod.firstIndex;
+            draw.command.baseVertex = (i32)submesh.arenaBaseVertex;
+            draw.params.firstInstance = firstInstance;
+            draw.params.materialIdx = model.materialIdx[i];
+            app->indirectDraws.push_back(draw);
+        }
+    }
 
-            ImGui::Text("Select Render:");
+    std::sort(app->indirectDraws.begin(), app->indirectDraws.end(), CompareIndirectDraws);
 
-            if (ImGui::Combo("##combo", &currentMode, modes, 2))
-            {
-                app->renderMode = currentMode;
-            }
+    const u32 drawCount = (u32)app->indirectDraws.size();
+    const u32 entityCount = (u32)app->instanceEntityOrder.size();
+    ReserveGeometryArenaDraws(app->geometryArena, drawCount);
+    // Align() needs a power of two, the commands are pushed 4-aligned
+    ReserveRingBuffer(app->indirectCommandBuffer, drawCount * sizeof(DrawElementsIndirectCommand), 4);
+    ReserveRingBuffer(app->indirectDrawParamsBuffer, drawCount * sizeof(IndirectDrawParams), app->storageBlockAlignment);
+    ReserveRingBuffer(app->indirectInstanceBuffer, entityCount * instanceSize, app->storageBlockAlignment);
 
-            ImGui::EndMenu();
-        }
+    BeginRingBufferFrame(app->indirectInstanceBuffer);
+    app->indirectInstancesOffset = app->indirectInstanceBuffer.head;
+    for (u32 i = 0; i < entityCount; ++i)
+    {
+        const Entity& entity = app->entities[app->instanceEntityOrder[i]];
+        const Mesh& mesh = app->meshes[app->models[entity.modelIdx].meshIdx];
+        glm::mat4 worldMatrix = glm::translate(entity.pos) * GetMeshDequantization(mesh);
+        glm::mat4 worldViewProjection = viewProjection * worldMatrix;
 
-        if (ImGui::BeginMenu("Render target"))
-        {
-            const char* renders[] = { "Albedo", "Normals" , "Position", "Depth" };
-            int currentRender = app->renderTarget;
+        PushMat4(app->indirectInstanceBuffer, worldMatrix);
+        PushMat4(app->indirectInstanceBuffer, worldViewProjection);
+    }
+    app->indirectInstancesSize = app->indirectInstanceBuffer.head - app->indirectInstancesOffset;
+    EndRingBufferFrame(app->indirectInstanceBuffer);
 
-            ImGui::Text("Select Mode:");
+    BeginRingBufferFrame(app->indirectCommandBuffer);
+    BeginRingBufferFrame(app->indirectDrawParamsBuffer);
+    app->indirectCommandsOffset = app->indirectCommandBuffer.head;
+    app->indirectDrawParamsOffset = app->indirectDrawParamsBuffer.head;
 
-            if (ImGui::Combo("##combo", &currentRender, renders, 4))
-            {
-                app->renderTarget = currentRender;
-            }
+    app->indirectBuckets.clear();
+    for (u32 d = 0; d < drawCount; ++d)
+    {
+        IndirectDraw& draw = app->indirectDraws[d];
+        draw.command.baseInstance = d;
 
-            ImGui::EndMenu();
-        }
+        PushAlignedData(app->indirectCommandBuffer, &draw.command, sizeof(draw.command), 4);
+        PushAlignedData(app->indirectDrawParamsBuffer, &draw.params, sizeof(draw.params), 4);
 
-        ImGui::EndMainMenuBar();
+        if (app->indirectBuckets.empty() || app->indirectBuckets.back().textureArrayIdx != draw.textureArrayIdx)
+        {
+            IndirectBucket bucket = {};
+            bucket.textureArrayIdx = draw.textureArrayIdx;
+            bucket.firstCommand = d;
+            app->indirectBuckets.push_back(bucket);
+        }
+        app->indirectBuckets.back().commandCount++;
     }
 
-    ImGui::Begin("Info");
-    ImGui::Text("FPS: %f", 1.0f / app->deltaTime);
-    ImGui::End();
+    app->indirectDrawParamsSize = app->indirectDrawParamsBuffer.head - app->indirectDrawParamsOffset;
+    EndRingBufferFrame(app->indirectCommandBuffer);
+    EndRingBufferFrame(app->indirectDrawParamsBuffer);
+}
 
-    ImGui::Begin("OpenGL Info");
-    ImGui::Text("Version: %s", app->glInfo.glVersion.c_str());
-    ImGui::Text("Renderer: %s", app->glInfo.glRenderer.c_str());
-    ImGui::Text("Vendor: %s", app->glInfo.glVendor.c_str());
-    ImGui::Text("GLSL Version: %s", app->glInfo.glShadingVersion.c_str());
+// Reloads the programs, textures and models whose files changed on disk
+void ReloadChangedAssets(App* app)
+{
+    TakeChangedFiles(app->fileWatcher, app->changedFiles);
 
-    ImGui::Separator();
-    ImGui::Text("Extensions");
-    for (size_t i = 0; i < app->glInfo.glExtensions.size(); ++i)
+    // Textures still streaming in and models still importing when they changed are tried again
+    app->changedFiles.insert(app->changedFiles.end(), app->deferredReloads.begin(), app->deferredReloads.end());
+    app->deferredReloads.clear();
+
+    for (u32 i = 0; i < app->changedFiles.size(); ++i)
     {
-        ImGui::Text("%s", app->glInfo.glVersion.c_str());
-    }
+        const std::string& path = app->changedFiles[i];
 
-    ImGui::End();
+        // Include files can be shared by several programs, each one is rebuilt once
+        for (u32 programIdx = 0; programIdx < app->programs.size(); ++programIdx)
+        {
+            Program& program = app->programs[programIdx];
+            if (std::find(program.sourceFiles.begin(), program.sourceFiles.end(), path) == program.sourceFiles.end())
+                continue;
+            if (GetNewestWriteTimestamp(program.sourceFiles) != program.lastWriteTimestamp)
+                ReloadProgram(app, programIdx);
+        }
+
+        const u32 texIdx = FindAsset(app->assets, MakeAssetKey(AssetType_Texture, path.c_str()));
+        if (texIdx != UINT32_MAX && !ReloadTexture(app, texIdx))
+            app->deferredReloads.push_back(path);
+
+        if (!ReloadModel(app, path.c_str()))
+            app->deferredReloads.push_back(path);
+    }
 }
 
 void Update(App* app)
 {
+    ReloadChangedAssets(app);
+
+    // Upload the assets the workers finished since the last frame
+    RunCompletions(app->jobSystem);
+    StreamTextures(app);
+    UpdateTextureTable(app);
+    UpdateMaterialTable(app);
+    FinishProgramCompiles(app, false);
+
     // You can handle app->input keyboard/mouse here
 
     app->cam.CalculateProjection(app->displaySize.x, app->displaySize.y);
@@ -625,9 +2505,19 @@ void Update(App* app)
         app->cam.ProcessMouseMovement(app->input.mouseDelta.x, -app->input.mouseDelta.y);
     }
 
+    if (app->input.mouseButtons[RIGHT] == BUTTON_PRESS)
+    {
+        app->pickedEntityIdx = PickEntity(app, app->input.mousePos);
+        if (app->pickedEntityIdx != BVH_NULL_NODE)
+        {
+            const Aabb aabb = GetEntityAabb(app, app->entities[app->pickedEntityIdx]);
+            app->orbitReference = (aabb.min + aabb.max) * 0.5f;
+        }
+    }
+
     if (app->input.mouseButtons[RIGHT] == BUTTON_PRESSED)
     {
-        vec3 reference = { 0,0,0 };
+        vec3 reference = app->orbitReference;
 
         vec3 dir = app->cam.Position - reference;
 
@@ -648,15 +2538,18 @@ void Update(App* app)
     if (app->mode == Mode_Model)
     {
 
-    MapBuffer(app->bufferGlobals, GL_WRITE_ONLY);
+    BeginRingBufferFrame(app->bufferGlobals);
 
     app->globalParamsOffset = app->bufferGlobals.head;
 
     PushVec3(app->bufferGlobals, app->cam.Position);
 
-    PushUInt(app->bufferGlobals, app->lights.size());
+    // GlobalParams holds a fixed size array, the clustered pass reads every light from
+    // the light buffer instead
+    const u32 forwardLightCount = glm::min((u32)app->lights.size(), (u32)MAX_FORWARD_LIGHTS);
+    PushUInt(app->bufferGlobals, forwardLightCount);
 
-    for (u32 i = 0; i < app->lights.size(); ++i)
+    for (u32 i = 0; i < forwardLightCount; ++i)
     {
         AlignHead(app->bufferGlobals, sizeof(vec4));
 
@@ -669,29 +2562,338 @@ void Update(App* app)
 
     app->globalParamsSize = app->bufferGlobals.head - app->globalParamsOffset;
 
-    UnmapBuffer(app->bufferGlobals);
+    EndRingBufferFrame(app->bufferGlobals);
 
-    MapBuffer(app->buffer, GL_WRITE_ONLY);
+    const glm::mat4 viewProjection = app->cam.GetProjectionMatrix() * app->cam.GetViewMatrix();
 
-    for (std::vector<Entity>::iterator it = app->entities.begin(); it < app->entities.end(); ++it)
+    UpdateEntityVisibility(app, viewProjection);
+    SelectEntityLods(app);
+    UpdateLightEntityOverlaps(app);
+
+    if (app->renderMode == 1 && app->deferredLighting == DeferredLighting_Clustered)
+        PushClusteredLights(app);
+
+    switch (app->entityRenderPath)
     {
-        AlignHead(app->buffer, app->uniformBlockAligment);
+        case EntityRenderPath_PerEntity: PushEntityParams(app, viewProjection); BuildRenderQueue(app); break;
+        case EntityRenderPath_Instanced: PushInstanceParams(app, viewProjection); break;
+        case EntityRenderPath_Indirect:  PushIndirectDraws(app, viewProjection); break;
+        default:;
+    }
+    }
+}
 
-        glm::mat4 worldMatrix = glm::translate((*it).pos);
-       // worldMatrix = glm::scale(worldMatrix, glm::vec3(0.9));
-        glm::mat4 worldViewProjection = app->cam.GetProjectionMatrix() * app->cam.GetViewMatrix() * worldMatrix;
+void RenderEntities(App* app)
+{
+    RenderQueue& queue = app->renderQueue;
+    RenderQueueStats& stats = queue.stats;
+    stats = RenderQueueStats{};
+
+    const u32 texturedMeshProgramIdx = GetGeometryProgram(app, app->texturedMeshProgramIdx);
+    u32 currentProgramIdx = UINT32_MAX;
+    GLuint currentVao = UINT32_MAX;
+    u32 currentTextureIdx = UINT32_MAX;
+    u32 currentEntityIdx = UINT32_MAX;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->bufferGlobals.handle, app->globalParamsOffset, app->globalParamsSize);
+    glActiveTexture(GL_TEXTURE0);
+
+    for (u32 q = 0; q < queue.items.size(); ++q)
+    {
+        const RenderItem& item = queue.items[q];
+        const Entity& entity = app->entities[item.entityIdx];
+        Model& model = app->models[entity.modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+        Submesh& submesh = mesh.submeshes[item.submeshIdx];
+
+        // The program is the same for every entity for now, but the queue is keyed by it
+        const u32 programIdx = texturedMeshProgramIdx;
+        Program& program = app->programs[programIdx];
+        if (programIdx != currentProgramIdx)
+        {
+            glUseProgram(program.handle);
+            glUniform1i(glGetUniformLocation(program.handle, "uTexture"), 0);
+            currentProgramIdx = programIdx;
+            stats.programBinds++;
+        }
+        else stats.skippedProgramBinds++;
+
+        const GLuint vao = FindVAO(mesh, item.submeshIdx, program);
+        if (vao != currentVao)
+        {
+            glBindVertexArray(vao);
+            currentVao = vao;
+            stats.vaoBinds++;
+        }
+        else stats.skippedVaoBinds++;
+
+        const u32 textureIdx = app->materials[model.materialIdx[item.submeshIdx]].albedoTextureIdx;
+        if (textureIdx != currentTextureIdx)
+        {
+            glBindTexture(GL_TEXTURE_2D, app->textures[textureIdx].handle);
+            currentTextureIdx = textureIdx;
+            stats.textureBinds++;
+        }
+        else stats.skippedTextureBinds++;
+
+        if (item.entityIdx != currentEntityIdx)
+        {
+            glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->buffer.pages[entity.localParamsPage].handle, entity.localParamsOffset, entity.localParamsSize);
+            currentEntityIdx = item.entityIdx;
+            stats.uniformBinds++;
+        }
+        else stats.skippedUniformBinds++;
+
+        if (item.rangeCount > 0)
+        {
+            glMultiDrawElements(GL_TRIANGLES, &app->meshletRangeCounts[item.firstRange], submesh.indexType,
+                &app->meshletRangeOffsets[item.firstRange], item.rangeCount);
+        }
+        else
+        {
+            const SubmeshLod& lod = GetSubmeshLod(submesh, app->entityLod[item.entityIdx]);
+            glDrawElements(GL_TRIANGLES, lod.indexCount, submesh.indexType, GetSubmeshLodIndexOffset(submesh, lod));
+        }
+        stats.drawCalls++;
+    }
+}
+
+void RenderEntitiesInstanced(App* app)
+{
+    Program& texturedMeshProgram = app->programs[GetGeometryProgram(app, app->texturedMeshInstancedProgramIdx)];
+    glUseProgram(texturedMeshProgram.handle);
+    glUniform1i(glGetUniformLocation(texturedMeshProgram.handle, "uTexture"), 0);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->bufferGlobals.handle, app->globalParamsOffset, app->globalParamsSize);
+
+    for (u32 b = 0; b < app->instanceBatches.size(); ++b)
+    {
+        const InstanceBatch& batch = app->instanceBatches[b];
+        Model& model = app->models[batch.modelIdx];
+        Mesh& mesh = app->meshes[model.meshIdx];
+
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, app->instanceBuffer.pages[batch.instanceParamsPage].handle,
+            batch.instanceParamsOffset, batch.instanceParamsSize);
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
+            glBindVertexArray(vao);
+
+            u32 submeshMaterialIdx = model.materialIdx[i];
+            Material& submeshMaterial = app->materials[submeshMaterialIdx];
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
+
+            Submesh& submesh = mesh.submeshes[i];
+            const SubmeshLod& lod = GetSubmeshLod(submesh, batch.lod);
+            glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, submesh.indexType, GetSubmeshLodIndexOffset(submesh, lod), batch.instanceCount);
+        }
+    }
+}
+
+void RenderEntitiesIndirect(App* app)
+{
+    if (app->indirectDraws.empty())
+        return;
+
+    const bool bindless = app->useBindlessTextures;
+    Program& texturedMeshProgram = app->programs[GetGeometryProgram(app, bindless ? app->texturedMeshIndirectBindlessProgramIdx : app->texturedMeshIndirectProgramIdx)];
+    glUseProgram(texturedMeshProgram.handle);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->bufferGlobals.handle, app->globalParamsOffset, app->globalParamsSize);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, app->indirectInstanceBuffer.handle, app->indirectInstancesOffset, app->indirectInstancesSize);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, app->indirectDrawParamsBuffer.handle, app->indirectDrawParamsOffset, app->indirectDrawParamsSize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, app->textureTableBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, app->materialBuffer);
+
+    glBindVertexArray(GetGeometryArenaVAO(app->geometryArena));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, app->indirectCommandBuffer.handle);
+
+    if (!bindless)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(texturedMeshProgram.handle, "uTextureArray"), 0);
+    }
+
+    for (u32 b = 0; b < app->indirectBuckets.size(); ++b)
+    {
+        const IndirectBucket& bucket = app->indirectBuckets[b];
+        const u32 commandsOffset = app->indirectCommandsOffset + bucket.firstCommand * sizeof(DrawElementsIndirectCommand);
+
+        if (!bindless)
+            glBindTexture(GL_TEXTURE_2D_ARRAY, app->textureArrays[bucket.textureArrayIdx].handle);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(u64)commandsOffset, bucket.commandCount, 0);
+    }
+
+    if (!bindless)
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// Binds the G-buffer to units 0-3 for a lighting program. With the compact layout there
+// is no position attachment, the shaders rebuild it from depth.
+void BindGBufferTextures(App* app, const Program& program)
+{
+    Framebuffer& gbuffer = GetGBuffer(app);
+    const bool compact = &gbuffer == &app->compactFBuffer;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gbuffer.colorAttachmentHandle);
+    glUniform1i(glGetUniformLocation(program.handle, "colColor"), 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, gbuffer.positionAttachmentHandle);
+    glUniform1i(glGetUniformLocation(program.handle, "posColor"), 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, gbuffer.normalAttachmentHandle);
+    glUniform1i(glGetUniformLocation(program.handle, "norColor"), 2);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, compact ? gbuffer.depthAttachmentHandle : 0);
+    glUniform1i(glGetUniformLocation(program.handle, "uDepth"), 3);
+
+    if (compact)
+    {
+        const glm::mat4 inverseViewProjection = glm::inverse(app->cam.GetProjectionMatrix() * app->cam.GetViewMatrix());
+        glUniformMatrix4fv(glGetUniformLocation(program.handle, "uInverseViewProjection"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+    }
+}
+
+// Shades every pixel with a single full screen quad, looping over all the lights or only
+// over the lights of the pixel cluster
+void RenderFullScreenLighting(App* app)
+{
+    const bool clustered = app->deferredLighting == DeferredLighting_Clustered;
+    if (clustered)
+        AssignLightsToClusters(app);
 
-        (*it).localParamsOffset = app->buffer.head;
+    // Only the full screen program loops over the global lights, the clustered one over the
+    // lights of the cluster
+    const u32 programIdx = clustered ? app->clusteredLightingProgramIdx : app->texturedGeometryProgramIdx3;
+    Program& programTexturedGeometry = app->programs[GetRenderProgram(app, programIdx, GetLightingKeywords(app), !clustered)];
+    glUseProgram(programTexturedGeometry.handle);
+    glBindVertexArray(app->vao2);
 
-        PushMat4(app->buffer, worldMatrix);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    BindGBufferTextures(app, programTexturedGeometry);
+
+    if (clustered)
+    {
+        glUniformMatrix4fv(glGetUniformLocation(programTexturedGeometry.handle, "uView"), 1, GL_FALSE, &app->cam.GetViewMatrix()[0][0]);
+        glUniform2f(glGetUniformLocation(programTexturedGeometry.handle, "uScreenSize"), (f32)app->displaySize.x, (f32)app->displaySize.y);
+        glUniform1f(glGetUniformLocation(programTexturedGeometry.handle, "uNear"), NEAR_PLANE);
+        glUniform1f(glGetUniformLocation(programTexturedGeometry.handle, "uFar"), FAR_PLANE);
+    }
+
+    glDrawElements(GL_TRIANGLES, sizeof(indices) / sizeof(u16), GL_UNSIGNED_SHORT, 0);
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
 
-        PushMat4(app->buffer, worldViewProjection);
+// The PointLight.obj sphere is low poly, its faces are inside the radius of its vertices
+#define LIGHT_VOLUME_SCALE_MARGIN 1.1f
 
-        (*it).localParamsSize = app->buffer.head - (*it).localParamsOffset;
+// Directional lights are applied with a full screen quad, then every point light draws a
+// sphere that covers its range. A stencil pass marks the pixels whose G-buffer depth is
+// inside the sphere so only those are shaded and added to the deferred target.
+void RenderLightVolumes(App* app)
+{
+    Program& directionalProgram = app->programs[GetRenderProgram(app, app->directionalLightingProgramIdx, GetLightingKeywords(app), true)];
+    glUseProgram(directionalProgram.handle);
+    glBindVertexArray(app->vao2);
+    glDisable(GL_BLEND);
+    BindGBufferTextures(app, directionalProgram);
+    glDrawElements(GL_TRIANGLES, sizeof(indices) / sizeof(u16), GL_UNSIGNED_SHORT, 0);
+
+    // The stencil pass tests against the depth of the G-buffer
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, GetGBuffer(app).framebufferHandle);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, app->deferredFBuffer.framebufferHandle);
+    glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->deferredFBuffer.framebufferHandle);
+
+    Program& volumeProgram = app->programs[GetRenderProgram(app, app->lightVolumeProgramIdx, GetLightingKeywords(app), false)];
+    glUseProgram(volumeProgram.handle);
+    BindGBufferTextures(app, volumeProgram);
+    glUniform2f(glGetUniformLocation(volumeProgram.handle, "uScreenSize"), (f32)app->displaySize.x, (f32)app->displaySize.y);
+    const GLint worldViewProjectionLocation = glGetUniformLocation(volumeProgram.handle, "uWorldViewProjection");
+    const GLint lightPositionLocation = glGetUniformLocation(volumeProgram.handle, "uLightPosition");
+    const GLint lightColorLocation = glGetUniformLocation(volumeProgram.handle, "uLightColor");
+
+    // The light model is still importing, it has no bounds to scale the volumes by yet
+    app->lightVolumeCount = 0;
+    Mesh& mesh = app->meshes[app->models[app->pointLightModel].meshIdx];
+    if (mesh.submeshes.empty())
+    {
+        glBindVertexArray(0);
+        glUseProgram(0);
+        return;
     }
+    const glm::mat4 viewProjection = app->cam.GetProjectionMatrix() * app->cam.GetViewMatrix();
+
+    glEnable(GL_STENCIL_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+
+    for (u32 l = 0; l < app->lights.size(); ++l)
+    {
+        const Light& light = app->lights[l];
+        if (light.type != LightType_Point)
+            continue;
+
+        const f32 scale = GetPointLightRadius(light) / mesh.sphere.radius * LIGHT_VOLUME_SCALE_MARGIN;
+        const glm::mat4 world = glm::translate(light.position) * glm::scale(glm::vec3(scale)) * glm::translate(-mesh.sphere.center) * GetMeshDequantization(mesh);
+        const glm::mat4 worldViewProjection = viewProjection * world;
+        glUniformMatrix4fv(worldViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(worldViewProjection));
+        glUniform3fv(lightPositionLocation, 1, glm::value_ptr(light.position));
+        glUniform3fv(lightColorLocation, 1, glm::value_ptr(light.color));
+
+        // Back faces behind the geometry increment and front faces behind it decrement,
+        // so pixels with geometry inside the sphere end up non zero. It also works with
+        // the camera inside the sphere, where the front faces get clipped.
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glStencilFunc(GL_ALWAYS, 0, 0);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            glBindVertexArray(FindVAO(mesh, i, volumeProgram));
+            glDrawElements(GL_TRIANGLES, mesh.submeshes[i].lods[0].indexCount, mesh.submeshes[i].indexType, (void*)(u64)mesh.submeshes[i].indexOffset);
+        }
+
+        // Back faces are still drawn with the camera inside the sphere. Shaded pixels
+        // reset their stencil so the next light starts from zero without a clear.
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            glBindVertexArray(FindVAO(mesh, i, volumeProgram));
+            glDrawElements(GL_TRIANGLES, mesh.submeshes[i].lods[0].indexCount, mesh.submeshes[i].indexType, (void*)(u64)mesh.submeshes[i].indexOffset);
+        }
 
-    UnmapBuffer(app->buffer);
+        app->lightVolumeCount++;
     }
+
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_STENCIL_TEST);
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindVertexArray(0);
+    glUseProgram(0);
 }
 
 void Render(App* app)
@@ -722,7 +2924,7 @@ void Render(App* app)
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-            glUniform1i(app->programUniformTexture, 0);
+            glUniform1i(glGetUniformLocation(programTexturedGeometry.handle, "uTexture"), 0);
             glActiveTexture(GL_TEXTURE0);
             GLuint textureHandle = app->textures[app->diceTexIdx].handle;
             glBindTexture(GL_TEXTURE_2D, textureHandle);
@@ -737,7 +2939,10 @@ void Render(App* app)
         {
             #pragma region G Buffer Pass
 
-            glBindFramebuffer(GL_FRAMEBUFFER, app->fbuffer.framebufferHandle);
+            Framebuffer& gbuffer = GetGBuffer(app);
+            glBindFramebuffer(GL_FRAMEBUFFER, gbuffer.framebufferHandle);
+
+            BeginGpuTimer(app->gbufferTimer);
 
             glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -745,35 +2950,12 @@ void Render(App* app)
 
             /// ENTITIES /////////////////////////////////////////////////
 
-            Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-            glUseProgram(texturedMeshProgram.handle);
-
-            for (std::vector<Entity>::iterator it = app->entities.begin(); it < app->entities.end(); ++it)
+            switch (app->entityRenderPath)
             {
-                Model& model = app->models[(*it).modelIdx];
-                Mesh& mesh = app->meshes[model.meshIdx];
-
-                glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->bufferGlobals.handle, app->globalParamsOffset, app->globalParamsSize);
-                glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->buffer.handle, (*it).localParamsOffset, (*it).localParamsSize);
-
-                for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-                {
-                    GLuint vao = FindVAO(mesh, i, texturedMeshProgram);
-                    glBindVertexArray(vao);
-
-                    u32 submeshMaterialIdx = model.materialIdx[i];
-                    Material& submeshMaterial = app->materials[submeshMaterialIdx];
-
-                    glActiveTexture(GL_TEXTURE0);
-                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                    glUniform1i(app->texturedMeshProgram_uTexture, 0);
-                    //glUniformMatrix4fv(glGetUniformLocation(texturedMeshProgram.handle, "view"), 1, GL_FALSE, &app->cam.GetViewMatrix()[0][0]);
-                    //glUniformMatrix4fv(glGetUniformLocation(texturedMeshProgram.handle, "proj"), 1, GL_FALSE, &app->cam.GetProjectionMatrix()[0][0]);
-                    //glUniform3fv(glGetUniformLocation(texturedMeshProgram.handle, "vViewDir"), 1, glm::value_ptr(app->cam.Front));
-
-                    Submesh& submesh = mesh.submeshes[i];
-                    glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-                }
+                case EntityRenderPath_PerEntity: RenderEntities(app); break;
+                case EntityRenderPath_Instanced: RenderEntitiesInstanced(app); break;
+                case EntityRenderPath_Indirect:  RenderEntitiesIndirect(app); break;
+                default:;
             }
 
             /// LIGHTS /////////////////////////////////////////////////
@@ -784,25 +2966,12 @@ void Render(App* app)
 
             for (std::vector<Light>::iterator it = app->lights.begin(); it < app->lights.end(); ++it)
             {
-                Model& model = app->models[app->directionalLightModel];
-
-                if ((*it).type == LightType_Directional)
-                    model = app->models[app->directionalLightModel];
-                if ((*it).type == LightType_Point)
-                    model = app->models[app->pointLightModel];
-
-                Mesh& mesh = app->meshes[model.meshIdx];
+                const Model& model = app->models[(*it).type == LightType_Point ? app->pointLightModel : app->directionalLightModel];
+                const Mesh& mesh = app->meshes[model.meshIdx];
 
                 for (u32 i = 0; i < mesh.submeshes.size(); ++i)
                 {
-                    GLuint vao = FindVAO(mesh, i, texturedLightProgram);
-
-                    //This is hardcoded because i don't know why the vao goes default to vao of model pointLight indeferent to what model is.
-                    if ((*it).type == LightType_Directional)
-                        vao = 21;
-                    if ((*it).type == LightType_Point)
-                        vao = 22;
-
+                    GLuint vao = FindVAO(app->meshes[model.meshIdx], i, texturedLightProgram);
                     glBindVertexArray(vao);
 
                     //u32 submeshMaterialIdx = model.materialIdx[i];
@@ -811,16 +2980,18 @@ void Render(App* app)
                     glActiveTexture(GL_TEXTURE0);
                     //glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
                     glUniform3fv(glGetUniformLocation(texturedLightProgram.handle, "lightColor"), 1, glm::value_ptr((*it).color));
-                    glUniformMatrix4fv(glGetUniformLocation(texturedLightProgram.handle, "model"), 1, GL_FALSE, glm::value_ptr(glm::translate(glm::mat4(1), (*it).position)));
+                    glUniformMatrix4fv(glGetUniformLocation(texturedLightProgram.handle, "model"), 1, GL_FALSE, glm::value_ptr(glm::translate(glm::mat4(1), (*it).position) * GetMeshDequantization(mesh)));
                     glUniformMatrix4fv(glGetUniformLocation(texturedLightProgram.handle, "view"), 1, GL_FALSE, &app->cam.GetViewMatrix()[0][0]);
                     glUniformMatrix4fv(glGetUniformLocation(texturedLightProgram.handle, "proj"), 1, GL_FALSE, &app->cam.GetProjectionMatrix()[0][0]);
 
-                    Submesh& submesh = mesh.submeshes[i];
-                    glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                    const Submesh& submesh = mesh.submeshes[i];
+                    glDrawElements(GL_TRIANGLES, submesh.lods[0].indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset);
                 }
             }
         
 
+            EndGpuTimer(app->gbufferTimer);
+
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
             #pragma endregion
 
@@ -831,31 +3002,16 @@ void Render(App* app)
                 glBindFramebuffer(GL_FRAMEBUFFER, app->deferredFBuffer.framebufferHandle);
 
                 glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
                 glViewport(0, 0, app->displaySize.x, app->displaySize.y);
 
-                Program& programTexturedGeometry = app->programs[app->texturedGeometryProgramIdx3];
-                glUseProgram(programTexturedGeometry.handle);
-                glBindVertexArray(app->vao2);
-
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.colorAttachmentHandle);
-                glUniform1i(glGetUniformLocation(programTexturedGeometry.handle, "colColor"), 0);
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.positionAttachmentHandle);
-                glUniform1i(glGetUniformLocation(programTexturedGeometry.handle, "posColor"), 1);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.normalAttachmentHandle);
-                glUniform1i(glGetUniformLocation(programTexturedGeometry.handle, "norColor"), 2);
-
-                glDrawElements(GL_TRIANGLES, sizeof(indices) / sizeof(u16), GL_UNSIGNED_SHORT, 0);
-
-                glBindVertexArray(0);
-                glUseProgram(0);
+                BeginGpuTimer(app->lightingTimer);
+                if (app->deferredLighting == DeferredLighting_LightVolumes)
+                    RenderLightVolumes(app);
+                else
+                    RenderFullScreenLighting(app);
+                EndGpuTimer(app->lightingTimer);
 
                 glBindFramebuffer(GL_FRAMEBUFFER, 0);
             }
@@ -878,7 +3034,7 @@ void Render(App* app)
 
             bool depth = false;
 
-            glUniform1i(app->programUniformTexture, 0);
+            glUniform1i(glGetUniformLocation(programTexturedGeometry.handle, "uTexture"), 0);
             glActiveTexture(GL_TEXTURE0);
 
             switch (app->renderTarget)
@@ -887,16 +3043,21 @@ void Render(App* app)
                 if (app->renderMode == 1)
                     glBindTexture(GL_TEXTURE_2D, app->deferredFBuffer.colorAttachmentHandle);
                 else
-                    glBindTexture(GL_TEXTURE_2D, app->fbuffer.colorAttachmentHandle);
+                    glBindTexture(GL_TEXTURE_2D, gbuffer.colorAttachmentHandle);
                 break;
             case 1:
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.positionAttachmentHandle);
+                glBindTexture(GL_TEXTURE_2D, gbuffer.normalAttachmentHandle);
                 break;
             case 2:
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.normalAttachmentHandle);
-                break;
+                // The compact layout doesn't store positions, depth is what they come from
+                if (gbuffer.positionAttachmentHandle)
+                {
+                    glBindTexture(GL_TEXTURE_2D, gbuffer.positionAttachmentHandle);
+                    break;
+                }
+                // fall through
             case 3:
-                glBindTexture(GL_TEXTURE_2D, app->fbuffer.depthAttachmentHandle);
+                glBindTexture(GL_TEXTURE_2D, gbuffer.depthAttachmentHandle);
                 depth = true;
                 break;
             }
@@ -907,9 +3068,33 @@ void Render(App* app)
 
             glBindVertexArray(0);
             glUseProgram(0);
+
+            FenceRingBufferFrame(app->bufferGlobals);
+            if (app->renderMode == 1 && app->deferredLighting == DeferredLighting_Clustered)
+                FenceRingBufferFrame(app->lightBuffer);
+            switch (app->entityRenderPath)
+            {
+                case EntityRenderPath_PerEntity: FencePagedBufferFrame(app->buffer); break;
+                case EntityRenderPath_Instanced: FencePagedBufferFrame(app->instanceBuffer); break;
+                case EntityRenderPath_Indirect:
+                    FenceRingBufferFrame(app->indirectCommandBuffer);
+                    FenceRingBufferFrame(app->indirectDrawParamsBuffer);
+                    FenceRingBufferFrame(app->indirectInstanceBuffer);
+                    break;
+                default:;
+            }
         }
         break;
         default:;
     }
 }
 
+void Shutdown(App* app)
+{
+    ShutdownFileWatcher(app->fileWatcher);
+    ShutdownJobSystem(app->jobSystem);
+
+    for (u32 i = 0; i < app->textureStreamRequests.size(); ++i)
+        delete app->textureStreamRequests[i].mips;
+    app->textureStreamRequests.clear();
+}
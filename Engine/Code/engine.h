@@ -6,6 +6,7 @@
 
 #include "platform.h"
 #include <glad/glad.h>
+#include "glextensions.h"
 
 #include "mesh.h"
 #include "material.h"
@@ -16,6 +17,13 @@
 #include "buffer.h"
 #include "Light.h"
 #include "framebuffer.h"
+#include "indirect.h"
+#include "renderqueue.h"
+#include "bvh.h"
+#include "jobs.h"
+#include "assets.h"
+#include "texture.h"
+#include "filewatch.h"
 
 typedef glm::vec2  vec2;
 typedef glm::vec3  vec3;
@@ -34,8 +42,14 @@ struct Image
 
 struct Texture
 {
-    GLuint      handle;
-    std::string filepath;
+    GLuint       handle; // 2D view of the layer
+    std::string  filepath;
+    TextureCodec codec;
+    u32          size; // of all the levels, 0 until streamed in
+    u32          arrayIdx;
+    u32          layer;
+    u32          minLevel; // smallest level streamed in so far
+    TextureKind  kind;
 };
 
 struct Program
@@ -43,10 +57,58 @@ struct Program
     GLuint             handle;
     std::string        filepath;
     std::string        programName;
-    u64                lastWriteTimestamp; // What is this for?
+    std::string        keywords; // permutation, e.g. "GBUFFER_COMPACT LIGHT_COUNT=4"
+    bool               compute;
+    std::vector<std::string> sourceFiles; // filepath and the files it includes
+    u64                lastWriteTimestamp; // newest of the source files, reloads skip programs that are up to date
     VertexShaderLayout vertexInputLayout;
 };
 
+// A program whose stages were handed to the driver but whose link hasn't been checked yet
+struct ProgramCompile
+{
+    GLuint handle; // differs from the program's while a reload is compiling
+    u32    programIdx;
+    u64    key;
+    GLuint shaders[2];
+    u32    shaderCount;
+};
+
+enum EntityRenderPath
+{
+    EntityRenderPath_PerEntity,
+    EntityRenderPath_Instanced,
+    EntityRenderPath_Indirect,
+    EntityRenderPath_Count
+};
+
+// How the deferred pass applies the lights to the G-buffer
+enum DeferredLighting
+{
+    DeferredLighting_FullScreen,   // every light for every pixel, up to MAX_FORWARD_LIGHTS
+    DeferredLighting_Clustered,    // lights binned into froxels by a compute pass
+    DeferredLighting_LightVolumes, // stencil tested spheres, one per point light
+    DeferredLighting_Count
+};
+
+// Attachments of the G-buffer written in deferred mode. Forward always uses the regular one
+enum GBufferLayout
+{
+    GBufferLayout_Regular, // RGBA16F color, position and normal (28 bytes per pixel with depth)
+    GBufferLayout_Compact, // RGBA8 albedo, RG16 octahedral normal, position from depth (12 bytes)
+    GBufferLayout_Count
+};
+
+#define GPU_TIMER_FRAMES 3
+
+// GL_TIME_ELAPSED queries read back a few frames later, so reading them never stalls
+struct GpuTimer
+{
+    GLuint queries[GPU_TIMER_FRAMES];
+    u32    frame;
+    f32    milliseconds;
+};
+
 enum Mode
 {
     Mode_TexturedQuad,
@@ -102,6 +164,23 @@ struct App
     std::vector<Model> models;
     std::vector<Program>  programs;
 
+    // Permutations by GetProgramCachePath, so each one is only compiled once. With
+    // KHR_parallel_shader_compile the compiles in flight are only checked once the
+    // driver is done with them, until then the permutations without LIGHT_COUNT are used.
+    std::unordered_map<std::string, u32> programPermutations;
+    std::vector<ProgramCompile> programCompiles;
+    bool parallelShaderCompile;
+
+    // Shaders, textures and models are reloaded when their files change. Changes to
+    // textures still streaming in and models still importing are retried on the next frames.
+    FileWatcher fileWatcher;
+    std::vector<std::string> changedFiles;
+    std::vector<std::string> deferredReloads;
+
+    // Asset loading, parsing and decoding runs on the workers
+    JobSystem jobSystem;
+    AssetRegistry assets;
+
     u32 pointLightModel;
     u32 directionalLightModel;
 
@@ -111,6 +190,9 @@ struct App
     u32 texturedGeometryProgramIdx3;
     u32 texturedGeometryProgramIdx4;
     u32 texturedMeshProgramIdx;
+    u32 texturedMeshInstancedProgramIdx;
+    u32 texturedMeshIndirectProgramIdx;
+    u32 texturedMeshIndirectBindlessProgramIdx; // UINT32_MAX without ARB_bindless_texture
     
     // texture indices
     u32 diceTexIdx;
@@ -121,6 +203,66 @@ struct App
 
     std::vector<Entity> entities;
 
+    EntityRenderPath entityRenderPath;
+
+    // Frustum culling
+    bool frustumCulling;
+    Frustum frustum;
+    SphereSoA entitySpheres;
+    std::vector<u8> entityVisible;
+    u32 visibleEntityCount;
+    u32 culledSubmeshCount;
+
+    // Meshlets of the per entity path out of the frustum or facing away are skipped, the
+    // rest are merged into ranges drawn with one glMultiDrawElements per submesh
+    bool meshletCulling;
+    std::vector<GLsizei> meshletRangeCounts;
+    std::vector<void*> meshletRangeOffsets;
+    u32 testedMeshletCount;
+    u32 culledMeshletCount;
+
+    // Level of detail of every visible entity, the coarsest whose error projects to less
+    // than lodErrorPixels, shifted by lodBias levels
+    std::vector<u8> entityLod;
+    f32 lodErrorPixels;
+    i32 lodBias;
+    u32 lodEntityCounts[MESH_MAX_LODS];
+
+    // Entity world bounds, moved with MoveEntity so only entities that leave their fat
+    // box are reinserted. Culls, picks and light overlaps query it instead of a full scan
+    Bvh entityBvh;
+    bool bvhCulling;
+    std::vector<u32> bvhResults;
+    std::vector<u32> lightEntityCounts; // entities inside the range of each point light
+    BvhBenchmarkResult bvhBenchmark;
+
+    // Right click orbits around the picked entity
+    vec3 orbitReference;
+    u32 pickedEntityIdx;
+
+    // Per entity path, sorted to minimize state changes
+    RenderQueue renderQueue;
+
+    // Instancing
+    std::vector<InstanceBatch> instanceBatches;
+    std::vector<u32> instanceEntityOrder; // entity indices sorted by model and LOD
+    std::vector<u32> instanceModelStart;
+    PagedBuffer instanceBuffer;
+    GLint storageBlockAlignment;
+
+    // Multi-draw indirect
+    GeometryArena geometryArena;
+    std::vector<IndirectDraw> indirectDraws;
+    std::vector<IndirectBucket> indirectBuckets;
+    RingBuffer indirectCommandBuffer;
+    RingBuffer indirectDrawParamsBuffer;
+    RingBuffer indirectInstanceBuffer;
+    u32 indirectCommandsOffset;
+    u32 indirectDrawParamsOffset;
+    u32 indirectDrawParamsSize;
+    u32 indirectInstancesOffset;
+    u32 indirectInstancesSize;
+
     // Mode
     Mode mode;
 
@@ -132,10 +274,6 @@ struct App
     GLuint embeddedVertices2;
     GLuint embeddedElements2;
 
-    // Location of the texture uniform in the textured quad shader
-    GLuint programUniformTexture;
-    GLuint texturedMeshProgram_uTexture;
-
     // VAO object to link our screen filling quad with our textured quad shader
     GLuint vao;
 
@@ -147,17 +285,63 @@ struct App
 
     std::vector<Light>lights;
 
+    // Clustered deferred lighting
+    DeferredLighting deferredLighting;
+    u32 clusterLightsProgramIdx;
+    u32 clusteredLightingProgramIdx;
+    RingBuffer lightBuffer;
+    u32 lightBufferOffset;
+    u32 lightBufferSize;
+    GLuint clusterGridBuffer;
+    GLuint clusterLightIndexBuffer;
+
+    // Light volumes
+    u32 directionalLightingProgramIdx;
+    u32 lightVolumeProgramIdx;
+    u32 lightVolumeCount;
+
     GLint maxUniformBufferSize;
     GLint uniformBlockAligment;
 
-    Buffer buffer;
-    Buffer bufferGlobals;
+    PagedBuffer buffer;
+    RingBuffer bufferGlobals;
 
     u32 globalParamsOffset;
     u32 globalParamsSize;
 
+    // Decoded textures are copied through a persistently mapped ring of pixel buffers,
+    // up to textureStreamBudget bytes per frame
+    RingBuffer textureUploadBuffer;
+    std::vector<TextureStreamRequest> textureStreamRequests;
+    std::vector<TextureStreamUpload> textureStreamUploads;
+    u32 textureStreamBudget;
+    u32 textureUploadBytes; // last frame
+
+    u32 textureCodecMask; // bit per TextureCodec the driver supports
+
+    // Texture storage and the table the multi-draw shaders sample it through. The table
+    // is uploaded again whenever a texture changes layer or streams in a level.
+    std::vector<TextureArray> textureArrays;
+    std::vector<GpuTexture> textureTable;
+    GLuint textureTableBuffer;
+    bool textureTableDirty;
+    bool bindlessTextures; // ARB_bindless_texture is supported, the arrays have handles
+    bool useBindlessTextures;
+
+    // Every material in one storage buffer, uploaded again only when materials are added
+    // or changed. Set materialsDirty after touching app->materials.
+    std::vector<GpuMaterial> materialTable;
+    GLuint materialBuffer;
+    bool materialsDirty;
+    u64 textureBytes[TextureCodec_Count]; // GPU memory of the streamed textures that are loaded
+    u64 textureArrayBytes; // GPU memory of the arrays, free layers included
+
     Framebuffer fbuffer;
     Framebuffer deferredFBuffer;
+    Framebuffer compactFBuffer;
+    GBufferLayout gbufferLayout;
+    GpuTimer gbufferTimer;
+    GpuTimer lightingTimer;
 
     int renderTarget;
     int renderMode;
@@ -165,10 +349,31 @@ struct App
 
 u32 LoadTexture2D(App* app, const char* filepath);
 
+/**
+ * Returns a texture that uses the placeholder handle until a worker has decoded the image,
+ * built its mips and block compressed them for their kind (or read all of that from the
+ * cooked texture), and the smallest mip has been streamed in. The larger ones follow
+ * over the next frames (see StreamTextures).
+ */
+u32 LoadTexture2DAsync(App* app, const char* filepath, u32 placeholderIdx, TextureKind kind);
+
+// Drops a reference to a loaded texture, its handle is deleted with the last one
+void ReleaseTexture(App* app, u32 texIdx);
+
+// Copies the submeshes into the arena from the blobs the mesh buffers were made from
+void AddMeshToGeometryArena(App* app, Mesh& mesh, const u8* vertexData, const u8* indexData);
+
+// Entities are created and moved through these so their bounds in the BVH stay current
+u32 AddEntity(App* app, const glm::vec3& position, u32 modelIdx);
+
+void MoveEntity(App* app, u32 entityIdx, const glm::vec3& position);
+
 void Init(App* app);
 
 void Gui(App* app);
 
 void Update(App* app);
 
-void Render(App* app);
\ No newline at end of file
+void Render(App* app);
+
+void Shutdown(App* app);
\ No newline at end of file
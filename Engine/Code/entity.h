@@ -23,9 +23,24 @@ public:
 
 	u32 modelIdx;
 
+	u32 bvhProxy;
+
+	u32 localParamsPage;
 	u32 localParamsOffset;
 	u32 localParamsSize;
 
 private:
 
-};
\ No newline at end of file
+};
+// A run of entities that share a model. Their per-instance data is a contiguous block of
+// a paged storage buffer, and each submesh is drawn once for all of them.
+struct InstanceBatch
+{
+	u32 modelIdx;
+	u32 lod;
+	u32 instanceCount;
+
+	u32 instanceParamsPage;
+	u32 instanceParamsOffset;
+	u32 instanceParamsSize;
+};
@@ -0,0 +1,153 @@
+#include "filewatch.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+static void AddChangedFile(FileWatcher* watcher, const std::string& path)
+{
+    for (u32 i = 0; i < watcher->changedFiles.size(); ++i)
+        if (watcher->changedFiles[i] == path)
+            return;
+    watcher->changedFiles.push_back(path);
+}
+
+#ifdef __linux__
+static void InotifyLoop(FileWatcher* watcher)
+{
+    alignas(struct inotify_event) char buffer[4096];
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(watcher->mutex);
+            if (watcher->quit)
+                return;
+        }
+
+        pollfd pollFd = { watcher->inotifyFd, POLLIN, 0 };
+        if (poll(&pollFd, 1, FILE_WATCH_PERIOD_MS) <= 0)
+            continue;
+
+        const ssize_t size = read(watcher->inotifyFd, buffer, sizeof(buffer));
+        if (size <= 0)
+            continue;
+
+        std::lock_guard<std::mutex> lock(watcher->mutex);
+        for (const char* cursor = buffer; cursor < buffer + size;)
+        {
+            const inotify_event* event = (const inotify_event*)cursor;
+            cursor += sizeof(inotify_event) + event->len;
+            if (event->len == 0)
+                continue;
+
+            // Directories are watched as a whole, only the watched files are reported
+            for (u32 i = 0; i < watcher->files.size(); ++i)
+            {
+                const WatchedFile& file = watcher->files[i];
+                if (file.directoryWatch == event->wd && file.filename == event->name)
+                    AddChangedFile(watcher, file.path);
+            }
+        }
+    }
+}
+#endif
+
+static void PollingLoop(FileWatcher* watcher)
+{
+    std::unique_lock<std::mutex> lock(watcher->mutex);
+    for (;;)
+    {
+        watcher->quitCondition.wait_for(lock, std::chrono::milliseconds(FILE_WATCH_PERIOD_MS), [watcher] { return watcher->quit; });
+        if (watcher->quit)
+            return;
+
+        for (u32 i = 0; i < watcher->files.size(); ++i)
+        {
+            WatchedFile& file = watcher->files[i];
+            const u64 lastWriteTimestamp = GetFileLastWriteTimestamp(file.path.c_str());
+            if (lastWriteTimestamp != file.lastWriteTimestamp)
+            {
+                file.lastWriteTimestamp = lastWriteTimestamp;
+                AddChangedFile(watcher, file.path);
+            }
+        }
+    }
+}
+
+void InitFileWatcher(FileWatcher& watcher)
+{
+    watcher.quit = false;
+    watcher.inotifyFd = -1;
+
+#ifdef __linux__
+    watcher.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.inotifyFd >= 0)
+    {
+        watcher.thread = std::thread(InotifyLoop, &watcher);
+        ILOG("Watching asset files with inotify");
+        return;
+    }
+    ELOG("inotify_init1() failed, polling the asset files instead");
+#endif
+
+    watcher.thread = std::thread(PollingLoop, &watcher);
+    ILOG("Polling asset files every %d ms", FILE_WATCH_PERIOD_MS);
+}
+
+void ShutdownFileWatcher(FileWatcher& watcher)
+{
+    {
+        std::lock_guard<std::mutex> lock(watcher.mutex);
+        watcher.quit = true;
+    }
+    watcher.quitCondition.notify_all();
+    if (watcher.thread.joinable())
+        watcher.thread.join();
+
+#ifdef __linux__
+    if (watcher.inotifyFd >= 0)
+        close(watcher.inotifyFd);
+#endif
+    watcher.inotifyFd = -1;
+    watcher.files.clear();
+    watcher.changedFiles.clear();
+}
+
+void WatchFile(FileWatcher& watcher, const char* path)
+{
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    for (u32 i = 0; i < watcher.files.size(); ++i)
+        if (watcher.files[i].path == path)
+            return;
+
+    WatchedFile file = {};
+    file.path = path;
+    file.directoryWatch = -1;
+    file.lastWriteTimestamp = GetFileLastWriteTimestamp(path);
+
+    const size_t separator = file.path.find_last_of("/\\");
+    const std::string directory = separator == std::string::npos ? std::string(".") : file.path.substr(0, separator);
+    file.filename = separator == std::string::npos ? file.path : file.path.substr(separator + 1);
+
+#ifdef __linux__
+    // Adding a directory that is already watched returns its descriptor again
+    if (watcher.inotifyFd >= 0)
+    {
+        file.directoryWatch = inotify_add_watch(watcher.inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (file.directoryWatch < 0)
+            ELOG("inotify_add_watch() failed on %s, changes to %s won't be seen", directory.c_str(), path);
+    }
+#endif
+
+    watcher.files.push_back(file);
+}
+
+void TakeChangedFiles(FileWatcher& watcher, std::vector<std::string>& changedFiles)
+{
+    changedFiles.clear();
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+    changedFiles.swap(watcher.changedFiles);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "platform.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// How often the polling fallback checks the timestamps, and how long the inotify thread
+// waits for events before checking if it has to quit
+#define FILE_WATCH_PERIOD_MS 250
+
+struct WatchedFile
+{
+	std::string path; // as passed to WatchFile
+	std::string filename;
+	int directoryWatch; // inotify descriptor of its directory, -1 when polling
+	u64 lastWriteTimestamp;
+};
+
+/**
+ * Reports changes to a set of files from a background thread. On Linux it waits for
+ * inotify events on the directories of the files, so editors that save by renaming a
+ * temporary file are seen too. Elsewhere, or if inotify can't be used, it polls the
+ * timestamps of the files every FILE_WATCH_PERIOD_MS.
+ */
+struct FileWatcher
+{
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable quitCondition;
+	bool quit;
+	int inotifyFd; // -1 when polling
+
+	std::vector<WatchedFile> files;
+	std::vector<std::string> changedFiles; // not taken yet, each one once
+};
+
+void InitFileWatcher(FileWatcher& watcher);
+
+void ShutdownFileWatcher(FileWatcher& watcher);
+
+// Does nothing if the file is already watched
+void WatchFile(FileWatcher& watcher, const char* path);
+
+// Moves the files changed since the last call to changedFiles
+void TakeChangedFiles(FileWatcher& watcher, std::vector<std::string>& changedFiles);
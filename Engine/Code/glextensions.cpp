@@ -0,0 +1,61 @@
+#include "glextensions.h"
+#include "platform.h"
+
+#ifndef GL_VERSION_4_4
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = NULL;
+#endif
+
+#ifndef GL_ARB_bindless_texture
+PFNGLGETTEXTUREHANDLEARBPROC glad_glGetTextureHandleARB = NULL;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glad_glMakeTextureHandleResidentARB = NULL;
+#endif
+
+#ifndef GL_KHR_parallel_shader_compile
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = NULL;
+#endif
+
+bool HasGLExtension(const std::vector<std::string>& extensions, const char* name)
+{
+    for (u32 i = 0; i < extensions.size(); ++i)
+        if (extensions[i] == name)
+            return true;
+    return false;
+}
+
+static bool IsGLVersionAtLeast(GLint major, GLint minor)
+{
+    GLint contextMajor = 0;
+    GLint contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+void LoadGLExtensions(const std::vector<std::string>& extensions)
+{
+#ifndef GL_VERSION_4_4
+    if (IsGLVersionAtLeast(4, 4) || HasGLExtension(extensions, "GL_ARB_buffer_storage"))
+    {
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)GetGLProcAddress("glBufferStorage");
+    }
+#endif
+
+#ifndef GL_ARB_bindless_texture
+    if (HasGLExtension(extensions, "GL_ARB_bindless_texture"))
+    {
+        glad_glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)GetGLProcAddress("glGetTextureHandleARB");
+        glad_glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)GetGLProcAddress("glMakeTextureHandleResidentARB");
+    }
+#endif
+
+#ifndef GL_KHR_parallel_shader_compile
+    if (HasGLExtension(extensions, "GL_KHR_parallel_shader_compile"))
+    {
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGLProcAddress("glMaxShaderCompilerThreadsKHR");
+    }
+    else if (HasGLExtension(extensions, "GL_ARB_parallel_shader_compile"))
+    {
+        glad_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGLProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+#endif
+}
@@ -0,0 +1,58 @@
+//
+// glextensions.h: OpenGL tokens and entry points that the bundled glad loader (core 4.3)
+// was not generated with. They are resolved at runtime by LoadGLExtensions() and stay
+// NULL when the driver does not expose them, so callers must check before using them.
+//
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// ARB_buffer_storage (core since 4.4)
+#ifndef GL_VERSION_4_4
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC glad_glBufferStorage;
+#define glBufferStorage glad_glBufferStorage
+#endif
+
+// ARB_bindless_texture (not core)
+#ifndef GL_ARB_bindless_texture
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+extern PFNGLGETTEXTUREHANDLEARBPROC glad_glGetTextureHandleARB;
+extern PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glad_glMakeTextureHandleResidentARB;
+#define glGetTextureHandleARB glad_glGetTextureHandleARB
+#define glMakeTextureHandleResidentARB glad_glMakeTextureHandleResidentARB
+#endif
+
+// KHR_parallel_shader_compile (not core), ARB_parallel_shader_compile has the same tokens
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+#endif
+
+// EXT_texture_compression_s3tc (BC1 to BC3, not core but exposed by every desktop driver)
+#ifndef GL_EXT_texture_compression_s3tc
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/**
+ * Resolves the entry points declared above. Each one is only loaded when the context
+ * version or the extension list says it is supported.
+ */
+void LoadGLExtensions(const std::vector<std::string>& extensions);
+
+bool HasGLExtension(const std::vector<std::string>& extensions, const char* name);
@@ -1,37 +1,58 @@
 
 #include "importer.h"
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, ImportedModel& model, u32 baseMeshMaterialIndex, MeshOptimizationStats& stats)
 {
-    std::vector<float> vertices;
-    std::vector<u32> indices;
+    const bool hasTexCoords = mesh->mTextureCoords[0] != nullptr;
+    const bool hasTangentSpace = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
 
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
+    // create the vertex format
+    VertexBufferLayout vertexBufferLayout = {};
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0, VertexAttributeType_Float });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float), VertexAttributeType_Float });
+    vertexBufferLayout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride, VertexAttributeType_Float });
+        vertexBufferLayout.stride += 2 * sizeof(float);
+    }
+    if (hasTangentSpace)
+    {
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride, VertexAttributeType_Float });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+
+        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride, VertexAttributeType_Float });
+        vertexBufferLayout.stride += 3 * sizeof(float);
+    }
+    const u32 floatStride = vertexBufferLayout.stride / sizeof(float);
 
-    // process vertices
+    Aabb aabb = MakeEmptyAabb();
+
+    // process vertices, sized up front and written in place
+    std::vector<float> vertices(mesh->mNumVertices * floatStride);
+    float* vertex = vertices.data();
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-        vertices.push_back(mesh->mNormals[i].x);
-        vertices.push_back(mesh->mNormals[i].y);
-        vertices.push_back(mesh->mNormals[i].z);
+        GrowAabb(aabb, vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
+
+        *vertex++ = mesh->mVertices[i].x;
+        *vertex++ = mesh->mVertices[i].y;
+        *vertex++ = mesh->mVertices[i].z;
+        *vertex++ = mesh->mNormals[i].x;
+        *vertex++ = mesh->mNormals[i].y;
+        *vertex++ = mesh->mNormals[i].z;
 
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        if (hasTexCoords)
         {
-            hasTexCoords = true;
-            vertices.push_back(mesh->mTextureCoords[0][i].x);
-            vertices.push_back(mesh->mTextureCoords[0][i].y);
+            *vertex++ = mesh->mTextureCoords[0][i].x;
+            *vertex++ = mesh->mTextureCoords[0][i].y;
         }
 
-        if (mesh->mTangents != nullptr && mesh->mBitangents)
+        if (hasTangentSpace)
         {
-            hasTangentSpace = true;
-            vertices.push_back(mesh->mTangents[i].x);
-            vertices.push_back(mesh->mTangents[i].y);
-            vertices.push_back(mesh->mTangents[i].z);
+            *vertex++ = mesh->mTangents[i].x;
+            *vertex++ = mesh->mTangents[i].y;
+            *vertex++ = mesh->mTangents[i].z;
 
             // For some reason ASSIMP gives me the bitangents flipped.
             // Maybe it's my fault, but when I generate my own geometry
@@ -41,53 +62,68 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 bas
             // I think that (even if the documentation says the opposite)
             // it returns a left-handed tangent space matrix.
             // SOLUTION: I invert the components of the bitangent here.
-            vertices.push_back(-mesh->mBitangents[i].x);
-            vertices.push_back(-mesh->mBitangents[i].y);
-            vertices.push_back(-mesh->mBitangents[i].z);
+            *vertex++ = -mesh->mBitangents[i].x;
+            *vertex++ = -mesh->mBitangents[i].y;
+            *vertex++ = -mesh->mBitangents[i].z;
         }
     }
 
     // process indices
+    u32 indexCount = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        indexCount += mesh->mFaces[i].mNumIndices;
+
+    std::vector<u32> indices(indexCount);
+    u32* index = indices.data();
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++)
-        {
-            indices.push_back(face.mIndices[j]);
-        }
+            *index++ = face.mIndices[j];
     }
 
     // store the proper (previously proceessed) material for this mesh
-    submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
+    model.submeshMaterials.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
 
-    // create the vertex format
-    VertexBufferLayout vertexBufferLayout = {};
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
-    vertexBufferLayout.stride = 6 * sizeof(float);
-    if (hasTexCoords)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 2 * sizeof(float);
-    }
-    if (hasTangentSpace)
-    {
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
+    // the submesh is filled in place, its geometry goes to the model blobs
+    Mesh& myMesh = model.mesh;
+    myMesh.submeshes.emplace_back();
+    Submesh& submesh = myMesh.submeshes.back();
 
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
-        vertexBufferLayout.stride += 3 * sizeof(float);
+    // reorder triangles for the post-transform cache and overdraw, then the vertices
+    // for the fetch, before they are quantized
+    OptimizeMesh(vertices, floatStride, 0, indices, stats);
+
+    // add the simplified LODs after the full indices
+    submesh.lodCount = GenerateLods(vertices, floatStride, 0, indices, submesh.lods, stats);
+
+    // split LOD 0 into meshlets so the parts out of view or facing away can be skipped
+    BuildMeshlets(vertices, floatStride, 0, indices.data(), submesh.lods[0].indexCount, submesh.meshlets);
+    if (submesh.meshlets.size() < 2)
+        submesh.meshlets.clear();
+    stats.meshletCount += (u32)submesh.meshlets.size();
+
+    // bounding sphere centered in the box, with the radius of the furthest vertex
+    BoundingSphere sphere = { (aabb.min + aabb.max) * 0.5f, 0.0f };
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        sphere.radius = glm::max(sphere.radius, glm::length(position - sphere.center));
     }
 
-    // add the submesh into the mesh
-    Submesh submesh = {};
-    submesh.vertexBufferLayout = vertexBufferLayout;
-    submesh.vertices.swap(vertices);
-    submesh.indices.swap(indices);
-    myMesh->submeshes.push_back(submesh);
+    submesh.aabb = aabb;
+    submesh.sphere = sphere;
+    submesh.vertexCount = (u32)vertices.size() / floatStride;
+    submesh.indexCount = (u32)indices.size();
+    submesh.indexType = ChooseIndexType(submesh.vertexCount);
+    submesh.vertexOffset = (u32)model.vertexStorage.size();
+    submesh.indexOffset = (u32)model.indexStorage.size();
+    QuantizeVertices(vertices, vertexBufferLayout, myMesh.positionOffset, myMesh.positionScale,
+        model.vertexStorage, submesh.vertexBufferLayout);
+    AppendIndices(indices, submesh.indexType, model.indexStorage);
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+void ProcessAssimpMaterial(aiMaterial* material, Material& myMaterial, MaterialTexturePaths& texturePaths, const std::string& directory)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -105,141 +141,397 @@ void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial,
     myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
     myMaterial.smoothness = shininess / 256.0f;
 
+    const aiTextureType textureTypes[MaterialTexture_Count] = {
+        aiTextureType_DIFFUSE,
+        aiTextureType_EMISSIVE,
+        aiTextureType_SPECULAR,
+        aiTextureType_NORMALS,
+        aiTextureType_HEIGHT,
+    };
+
     aiString aiFilename;
-    if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-    {
-        material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-    {
-        material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
-    {
-        material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+    for (u32 i = 0; i < MaterialTexture_Count; ++i)
     {
-        material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
-    }
-    if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
-    {
-        material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        if (material->GetTextureCount(textureTypes[i]) > 0)
+        {
+            material->GetTexture(textureTypes[i], 0, &aiFilename);
+            texturePaths.paths[i] = directory + "/" + aiFilename.C_Str();
+        }
     }
 
     //myMaterial.createNormalFromBump();
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ProcessAssimpNode(const aiScene* scene, aiNode* node, ImportedModel& model, u32 baseMeshMaterialIndex, MeshOptimizationStats& stats)
 {
     // process all the node's meshes (if any)
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        ProcessAssimpMesh(scene, mesh, model, baseMeshMaterialIndex, stats);
     }
 
     // then do the same for each of its children
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        ProcessAssimpNode(scene, node->mChildren[i], model, baseMeshMaterialIndex, stats);
     }
 }
 
-u32 LoadModel(App* app, const char* filename)
+void LoadMaterialTextures(App* app, Material& material, const MaterialTexturePaths& texturePaths, std::vector<u32>& loadedTextures)
 {
-    const aiScene* scene = aiImportFile(filename,
-        aiProcess_Triangulate |
-        aiProcess_GenSmoothNormals |
-        aiProcess_CalcTangentSpace |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_PreTransformVertices |
-        aiProcess_ImproveCacheLocality |
-        aiProcess_OptimizeMeshes |
-        aiProcess_SortByPType);
+    u32* textureIndices[MaterialTexture_Count] = {
+        &material.albedoTextureIdx,
+        &material.emissiveTextureIdx,
+        &material.specularTextureIdx,
+        &material.normalsTextureIdx,
+        &material.bumpTextureIdx,
+    };
+
+    // Neutral textures stand in for the real ones until they are decoded
+    const u32 placeholders[MaterialTexture_Count] = {
+        app->whiteTexIdx,
+        app->blackTexIdx,
+        app->whiteTexIdx,
+        app->normalTexIdx,
+        app->blackTexIdx,
+    };
+
+    // Normal maps are compressed as two channels, everything else as color
+    const TextureKind kinds[MaterialTexture_Count] = {
+        TextureKind_Color,
+        TextureKind_Color,
+        TextureKind_Color,
+        TextureKind_Normal,
+        TextureKind_Color,
+    };
+
+    for (u32 i = 0; i < MaterialTexture_Count; ++i)
+    {
+        if (!texturePaths.paths[i].empty())
+        {
+            *textureIndices[i] = LoadTexture2DAsync(app, texturePaths.paths[i].c_str(), placeholders[i], kinds[i]);
+            loadedTextures.push_back(*textureIndices[i]);
+        }
+    }
+}
 
-    if (!scene)
+static std::string GetDirectory(const std::string& path)
+{
+    const size_t separator = path.find_last_of("/\\");
+    return separator == std::string::npos ? std::string(".") : path.substr(0, separator);
+}
+
+bool ImportModel(const char* filename, ImportedModel& model)
+{
+    MappedFile source = MapFile(filename);
+    if (!source.data)
     {
-        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-        return UINT32_MAX;
+        ELOG("Error loading mesh %s: can't read the file", filename);
+        return false;
     }
 
-    app->meshes.push_back(Mesh{});
-    Mesh& mesh = app->meshes.back();
-    u32 meshIdx = (u32)app->meshes.size() - 1u;
+    const u64 sourceHash = HashMeshSource(source, MODEL_IMPORT_FLAGS);
+    model.sourceHash = sourceHash;
+    UnmapFile(source);
 
-    app->models.push_back(Model{});
-    Model& model = app->models.back();
-    model.meshIdx = meshIdx;
-    u32 modelIdx = (u32)app->models.size() - 1u;
+    if (ReadMeshCache(filename, sourceHash, MODEL_IMPORT_FLAGS, model))
+        return true;
+
+    // Imported by path so relative files (.mtl, textures) are found next to the model
+    const aiScene* scene = aiImportFile(filename, MODEL_IMPORT_FLAGS);
+
+    if (!scene)
+    {
+        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
+        return false;
+    }
 
-    String directory = GetDirectoryPart(MakeString(filename));
+    const std::string directory = GetDirectory(filename);
 
     // Create a list of materials
-    u32 baseMeshMaterialIndex = (u32)app->materials.size();
+    model.materials.resize(scene->mNumMaterials);
+    model.texturePaths.resize(scene->mNumMaterials);
     for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+        ProcessAssimpMaterial(scene->mMaterials[i], model.materials[i], model.texturePaths[i], directory);
+
+    // Vertices are pretransformed, so the bounds of all the scene meshes are the bounds
+    // of the model. Positions are quantized relative to them
+    Aabb sceneAabb = MakeEmptyAabb();
+    u32 vertexCount = 0;
+    u32 indexCount = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        const aiMesh* sceneMesh = scene->mMeshes[i];
+        for (unsigned int j = 0; j < sceneMesh->mNumVertices; ++j)
+            GrowAabb(sceneAabb, vec3(sceneMesh->mVertices[j].x, sceneMesh->mVertices[j].y, sceneMesh->mVertices[j].z));
+        vertexCount += sceneMesh->mNumVertices;
+        indexCount += sceneMesh->mNumFaces * 3;
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+    // Quantized vertices take at most 20 bytes, and a chain of LODs that halve the
+    // triangles is under twice the indices of LOD 0
+    model.vertexStorage.reserve(vertexCount * 20);
+    model.indexStorage.reserve(indexCount * 2 * sizeof(u32));
+
+    Mesh& mesh = model.mesh;
+    if (scene->mNumMeshes > 0)
+    {
+        const vec3 extent = sceneAabb.max - sceneAabb.min;
+        mesh.positionOffset = sceneAabb.min;
+        mesh.positionScale = glm::max(extent.x, glm::max(extent.y, extent.z));
+    }
+    MeshOptimizationStats stats = {};
+    ProcessAssimpNode(scene, scene->mRootNode, model, 0, stats);
 
     aiReleaseImport(scene);
 
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
+    mesh.aabb = MakeEmptyAabb();
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        GrowAabb(mesh.aabb, mesh.submeshes[i].aabb);
 
+    mesh.sphere.center = (mesh.aabb.min + mesh.aabb.max) * 0.5f;
+    mesh.sphere.radius = 0.0f;
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
+        const BoundingSphere& submeshSphere = mesh.submeshes[i].sphere;
+        mesh.sphere.radius = glm::max(mesh.sphere.radius, glm::length(submeshSphere.center - mesh.sphere.center) + submeshSphere.radius);
     }
 
-    glGenBuffers(1, &mesh.vertexBufferHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+    model.vertexData = model.vertexStorage.data();
+    model.vertexDataSize = (u32)model.vertexStorage.size();
+    model.indexData = model.indexStorage.data();
+    model.indexDataSize = (u32)model.indexStorage.size();
 
+    if (stats.triangleCount > 0)
+        ILOG("Optimized %s (cache of %u): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", filename, MESH_OPT_CACHE_SIZE,
+            (f32)stats.transformsBefore / stats.triangleCount, (f32)stats.transformsAfter / stats.triangleCount,
+            (f32)stats.transformsBefore / stats.vertexCount, (f32)stats.transformsAfter / stats.vertexCount);
+
+    UpdateMeshLodErrors(mesh);
+    if (mesh.lodCount > 1)
+        ILOG("LODs of %s: %u, %u, %u, %u triangles", filename, stats.lodTriangleCounts[0], stats.lodTriangleCounts[1],
+            stats.lodTriangleCounts[2], stats.lodTriangleCounts[3]);
+    if (stats.meshletCount > 0)
+        ILOG("Split %s into %u meshlets", filename, stats.meshletCount);
+
+    if (WriteMeshCache(filename, sourceHash, MODEL_IMPORT_FLAGS, model))
+        ILOG("Cooked mesh %s", filename);
+
+    return true;
+}
+
+// Creates the buffers of a mesh. The blobs, from the cooked file or the import, are laid
+// out exactly as the buffers, one upload each
+static void UploadMesh(App* app, Mesh& mesh, const ImportedModel& importedModel)
+{
+    glGenBuffers(1, &mesh.vertexBufferHandle);
     glGenBuffers(1, &mesh.indexBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
 
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+    glBufferData(GL_ARRAY_BUFFER, importedModel.vertexDataSize, importedModel.vertexData, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, importedModel.indexDataSize, importedModel.indexData, GL_STATIC_DRAW);
 
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    AddMeshToGeometryArena(app, mesh, importedModel.vertexData, importedModel.indexData);
+}
+
+u32 ReserveModel(App* app)
+{
+    app->models.push_back(Model{});
+    Model& model = app->models.back();
+    model.meshIdx = EMPTY_MESH_IDX;
+    return (u32)app->models.size() - 1u;
+}
+
+void UploadImportedModel(App* app, u32 modelIdx, ImportedModel& importedModel)
+{
+    // Identical source files share the mesh, each model still gets its own materials
+    // since their textures are relative to the model directory
+    const AssetKey meshKey = MakeContentAssetKey(AssetType_Mesh, importedModel.sourceHash);
+    u32 meshIdx = AcquireAsset(app->assets, meshKey);
+    if (meshIdx == UINT32_MAX)
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
+        meshIdx = (u32)app->meshes.size();
+        app->meshes.push_back(std::move(importedModel.mesh));
+        RegisterAsset(app->assets, meshKey, AssetType_Mesh, meshIdx, "");
+        UploadMesh(app, app->meshes[meshIdx], importedModel);
+    }
+
+    if (importedModel.cookedFile.data)
+        UnmapFile(importedModel.cookedFile);
+
+    Model& model = app->models[modelIdx];
+    model.meshIdx = meshIdx;
+    model.meshKey = meshKey;
 
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
-        indicesOffset += indicesSize;
+    u32 baseMeshMaterialIndex = (u32)app->materials.size();
+    for (u32 i = 0; i < importedModel.materials.size(); ++i)
+    {
+        app->materials.push_back(importedModel.materials[i]);
+        LoadMaterialTextures(app, app->materials.back(), importedModel.texturePaths[i], model.textureIdx);
     }
+    app->materialsDirty = true;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (u32 i = 0; i < importedModel.submeshMaterials.size(); ++i)
+        model.materialIdx.push_back(baseMeshMaterialIndex + importedModel.submeshMaterials[i]);
+
+    // Entities placed while the model was loading have empty bounds
+    for (u32 i = 0; i < app->entities.size(); ++i)
+        if (app->entities[i].modelIdx == modelIdx)
+            MoveEntity(app, i, app->entities[i].pos);
+}
+
+u32 LoadModel(App* app, const char* filename)
+{
+    const AssetKey key = MakeAssetKey(AssetType_Model, filename);
+    const u32 loadedModelIdx = AcquireAsset(app->assets, key);
+    if (loadedModelIdx != UINT32_MAX)
+        return loadedModelIdx;
+
+    ImportedModel importedModel = {};
+    if (!ImportModel(filename, importedModel))
+        return UINT32_MAX;
+
+    u32 modelIdx = ReserveModel(app);
+    RegisterAsset(app->assets, key, AssetType_Model, modelIdx, filename);
+    WatchFile(app->fileWatcher, filename);
+    UploadImportedModel(app, modelIdx, importedModel);
+    return modelIdx;
+}
+
+u32 LoadModelAsync(App* app, const char* filename)
+{
+    const AssetKey key = MakeAssetKey(AssetType_Model, filename);
+    const u32 loadedModelIdx = AcquireAsset(app->assets, key);
+    if (loadedModelIdx != UINT32_MAX)
+        return loadedModelIdx;
+
+    u32 modelIdx = ReserveModel(app);
+    RegisterAsset(app->assets, key, AssetType_Model, modelIdx, filename);
+    WatchFile(app->fileWatcher, filename);
+    app->models[modelIdx].importing = true;
+
+    JobSystem* jobSystem = &app->jobSystem;
+    std::string path = filename;
+    PushJob(*jobSystem, [app, jobSystem, path, key, modelIdx]() {
+        ImportedModel* importedModel = new ImportedModel();
+        const bool imported = ImportModel(path.c_str(), *importedModel);
+
+        PushCompletion(*jobSystem, [app, importedModel, imported, key, modelIdx]() {
+            app->models[modelIdx].importing = false;
+
+            // The model may have been released while it was being imported
+            if (imported && FindAsset(app->assets, key) == modelIdx)
+                UploadImportedModel(app, modelIdx, *importedModel);
+            else if (importedModel->cookedFile.data)
+                UnmapFile(importedModel->cookedFile);
+            delete importedModel;
+        });
+    });
 
     return modelIdx;
-}
\ No newline at end of file
+}
+
+// Drops a model's reference to its mesh, the last one frees the buffers
+static void ReleaseModelMesh(App* app, u32 meshIdx, AssetKey meshKey)
+{
+    if (meshIdx == EMPTY_MESH_IDX)
+        return;
+    const u32 refCount = ReleaseAsset(app->assets, meshKey);
+    if (refCount == UINT32_MAX || refCount > 0)
+        return;
+
+    // The copy in the geometry arena is not reclaimed, the arena only grows
+    Mesh& mesh = app->meshes[meshIdx];
+    glDeleteBuffers(1, &mesh.vertexBufferHandle);
+    glDeleteBuffers(1, &mesh.indexBufferHandle);
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        for (u32 j = 0; j < mesh.submeshes[i].vaos.size(); ++j)
+            glDeleteVertexArrays(1, &mesh.submeshes[i].vaos[j].handle);
+    mesh = Mesh{};
+}
+
+bool ReloadModel(App* app, const char* filename)
+{
+    const AssetKey key = MakeAssetKey(AssetType_Model, filename);
+    const u32 modelIdx = FindAsset(app->assets, key);
+    if (modelIdx == UINT32_MAX)
+        return true;
+
+    // Both completions would upload into the model, the second one leaking the first mesh
+    if (app->models[modelIdx].importing)
+        return false;
+    app->models[modelIdx].importing = true;
+
+    JobSystem* jobSystem = &app->jobSystem;
+    std::string path = filename;
+    PushJob(*jobSystem, [app, jobSystem, path, key, modelIdx]() {
+        ImportedModel* importedModel = new ImportedModel();
+        const bool imported = ImportModel(path.c_str(), *importedModel);
+
+        PushCompletion(*jobSystem, [app, importedModel, imported, path, key, modelIdx]() {
+            app->models[modelIdx].importing = false;
+
+            // The model may have been released while it was being imported
+            if (!imported || FindAsset(app->assets, key) != modelIdx)
+            {
+                if (importedModel->cookedFile.data)
+                    UnmapFile(importedModel->cookedFile);
+                delete importedModel;
+                return;
+            }
+
+            // The previous materials stay in their slots, unused. Textures with the same
+            // path are acquired again before the old references are dropped, so they
+            // aren't decoded again.
+            Model& model = app->models[modelIdx];
+            const u32 previousMeshIdx = model.meshIdx;
+            const AssetKey previousMeshKey = model.meshKey;
+            std::vector<u32> previousTextures;
+            previousTextures.swap(model.textureIdx);
+            model.materialIdx.clear();
+
+            UploadImportedModel(app, modelIdx, *importedModel);
+            ReleaseModelMesh(app, previousMeshIdx, previousMeshKey);
+            for (u32 i = 0; i < previousTextures.size(); ++i)
+                ReleaseTexture(app, previousTextures[i]);
+
+            ILOG("Reloaded model %s", path.c_str());
+            delete importedModel;
+        });
+    });
+
+    return true;
+}
+
+void ReleaseModel(App* app, const char* filename)
+{
+    const AssetKey key = MakeAssetKey(AssetType_Model, filename);
+    const u32 modelIdx = AcquireAsset(app->assets, key);
+    if (modelIdx == UINT32_MAX)
+    {
+        ELOG("Releasing model %s, which is not loaded", filename);
+        return;
+    }
+
+    // Drop the reference just taken and the caller's one
+    ReleaseAsset(app->assets, key);
+    const u32 refCount = ReleaseAsset(app->assets, key);
+    if (refCount == UINT32_MAX || refCount > 0)
+        return;
+
+    // The slots stay so other indices don't change, entities using the model draw nothing.
+    // A model released before its import completes is skipped by the completion.
+    Model& model = app->models[modelIdx];
+    ReleaseModelMesh(app, model.meshIdx, model.meshKey);
+
+    for (u32 i = 0; i < model.textureIdx.size(); ++i)
+        ReleaseTexture(app, model.textureIdx[i]);
+
+    model = Model{};
+    model.meshIdx = EMPTY_MESH_IDX;
+}
@@ -5,11 +5,58 @@
 #include <assimp/postprocess.h>
 
 #include "engine.h"
+#include "meshcache.h"
+#include "meshopt.h"
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+// Post processing applied to every imported model, part of the cooked mesh cache key
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | \
+                            aiProcess_GenSmoothNormals | \
+                            aiProcess_CalcTangentSpace | \
+                            aiProcess_JoinIdenticalVertices | \
+                            aiProcess_PreTransformVertices | \
+                            aiProcess_ImproveCacheLocality | \
+                            aiProcess_OptimizeMeshes | \
+                            aiProcess_SortByPType)
 
-void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory);
+void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, ImportedModel& model, u32 baseMeshMaterialIndex, MeshOptimizationStats& stats);
 
-void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+void ProcessAssimpMaterial(aiMaterial* material, Material& myMaterial, MaterialTexturePaths& texturePaths, const std::string& directory);
 
-u32 LoadModel(App* app, const char* filename);
\ No newline at end of file
+void ProcessAssimpNode(const aiScene* scene, aiNode* node, ImportedModel& model, u32 baseMeshMaterialIndex, MeshOptimizationStats& stats);
+
+// Loads the textures of a material in the background, with placeholders until they are
+// resident. The indices are appended to loadedTextures, which holds a reference to each
+void LoadMaterialTextures(App* app, Material& material, const MaterialTexturePaths& texturePaths, std::vector<u32>& loadedTextures);
+
+/**
+ * Reads the cooked version of the model if it is up to date, otherwise imports it with
+ * Assimp and cooks it for the next run. Doesn't touch the App or OpenGL, so it can run
+ * on a worker thread.
+ */
+bool ImportModel(const char* filename, ImportedModel& model);
+
+// Adds an empty model that an imported model can be uploaded into later
+u32 ReserveModel(App* app);
+
+// GL thread part of the load: buffers, materials, textures and the geometry arena
+void UploadImportedModel(App* app, u32 modelIdx, ImportedModel& importedModel);
+
+// Loading a model that is already loaded (or loading) returns the same model
+u32 LoadModel(App* app, const char* filename);
+
+/**
+ * Returns the index of a model that stays empty until a worker has imported it and the
+ * main thread has drained its completion. Entities can use it right away.
+ */
+u32 LoadModelAsync(App* app, const char* filename);
+
+/**
+ * Imports a loaded model again on a worker. Its completion swaps in the new mesh and
+ * materials, entities keep pointing at the same model. Returns false if the model can't
+ * be reloaded yet because an import of it is still running.
+ */
+bool ReloadModel(App* app, const char* filename);
+
+// Drops a reference to a model. The last one frees its mesh, if no other model shares it,
+// and its textures
+void ReleaseModel(App* app, const char* filename);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "platform.h"
+
+// Layout mandated by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	u32 count;
+	u32 instanceCount;
+	u32 firstIndex;
+	i32 baseVertex;
+	u32 baseInstance;
+};
+
+// Per draw data read by the shader through the draw id (std430)
+struct IndirectDrawParams
+{
+	u32 firstInstance;
+	u32 materialIdx;
+};
+
+// A draw collected during Update(), before being sorted and written to the GPU
+struct IndirectDraw
+{
+	u32 textureArrayIdx; // all the same with bindless textures
+	DrawElementsIndirectCommand command;
+	IndirectDrawParams params;
+};
+
+// A run of consecutive commands submitted with a single glMultiDrawElementsIndirect
+struct IndirectBucket
+{
+	u32 textureArrayIdx;
+	u32 firstCommand;
+	u32 commandCount;
+};
@@ -0,0 +1,97 @@
+#include "jobs.h"
+
+static void WorkerLoop(JobSystem* jobSystem)
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobSystem->jobsMutex);
+            jobSystem->jobsCondition.wait(lock, [jobSystem] { return jobSystem->quit || !jobSystem->jobs.empty(); });
+            if (jobSystem->quit)
+                return;
+
+            job = std::move(jobSystem->jobs.front());
+            jobSystem->jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void InitJobSystem(JobSystem& jobSystem, u32 threadCount)
+{
+    if (threadCount == 0)
+    {
+        const u32 hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    jobSystem.quit = false;
+    jobSystem.pendingCount = 0;
+    for (u32 i = 0; i < threadCount; ++i)
+        jobSystem.workers.push_back(std::thread(WorkerLoop, &jobSystem));
+
+    ILOG("Job system started with %u workers", threadCount);
+}
+
+void ShutdownJobSystem(JobSystem& jobSystem)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.jobsMutex);
+        jobSystem.quit = true;
+        jobSystem.jobs.clear();
+    }
+    jobSystem.jobsCondition.notify_all();
+
+    for (u32 i = 0; i < jobSystem.workers.size(); ++i)
+        jobSystem.workers[i].join();
+    jobSystem.workers.clear();
+
+    // Completions own the results of finished jobs, let them free their data
+    RunCompletions(jobSystem);
+    jobSystem.pendingCount = 0;
+}
+
+void PushJob(JobSystem& jobSystem, Job work)
+{
+    jobSystem.pendingCount++;
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.jobsMutex);
+        jobSystem.jobs.push_back(std::move(work));
+    }
+    jobSystem.jobsCondition.notify_one();
+}
+
+void PushCompletion(JobSystem& jobSystem, Job completion)
+{
+    std::lock_guard<std::mutex> lock(jobSystem.completionsMutex);
+    jobSystem.completions.push_back(std::move(completion));
+}
+
+u32 RunCompletions(JobSystem& jobSystem)
+{
+    std::vector<Job> completions;
+    {
+        std::lock_guard<std::mutex> lock(jobSystem.completionsMutex);
+        completions.swap(jobSystem.completions);
+    }
+
+    // Completions may push more jobs (a model pushing its textures), so they run unlocked
+    for (u32 i = 0; i < completions.size(); ++i)
+    {
+        completions[i]();
+        ASSERT(jobSystem.pendingCount > 0, "More completions than pushed jobs");
+        jobSystem.pendingCount--;
+    }
+
+    return (u32)completions.size();
+}
+
+void WaitForJobs(JobSystem& jobSystem)
+{
+    while (jobSystem.pendingCount > 0)
+    {
+        if (RunCompletions(jobSystem) == 0)
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "platform.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+typedef std::function<void()> Job;
+
+// Thread pool for asset loading. Jobs run on the workers and must not touch OpenGL or
+// the frame arena (MakeString, MakePath...). Work that needs the GL context is pushed
+// as a completion and runs on the main thread when the completions are drained.
+struct JobSystem
+{
+	std::vector<std::thread> workers;
+	std::deque<Job> jobs;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+	bool quit;
+
+	std::vector<Job> completions;
+	std::mutex completionsMutex;
+
+	u32 pendingCount; // pushed jobs whose completions haven't run yet, main thread only
+};
+
+// threadCount 0 uses one worker per hardware thread minus the main one
+void InitJobSystem(JobSystem& jobSystem, u32 threadCount);
+
+void ShutdownJobSystem(JobSystem& jobSystem);
+
+/**
+ * Runs work on a worker. Every job must push exactly one completion, even if it fails,
+ * so the pending count goes back to zero.
+ */
+void PushJob(JobSystem& jobSystem, Job work);
+
+// Called from the workers
+void PushCompletion(JobSystem& jobSystem, Job completion);
+
+/**
+ * Runs the completions pushed since the last call on the calling (GL) thread and
+ * returns how many ran.
+ */
+u32 RunCompletions(JobSystem& jobSystem);
+
+// Blocks the main thread until every pushed job has completed
+void WaitForJobs(JobSystem& jobSystem);
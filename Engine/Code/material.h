@@ -13,4 +13,34 @@ struct Material
 	u32 specularTextureIdx;
 	u32 normalsTextureIdx;
 	u32 bumpTextureIdx;
+};
+
+// Entry of the material table read by the shaders (std430), indexed like App::materials.
+// The texture indices are in the texture table.
+struct GpuMaterial
+{
+	glm::vec3 albedo;
+	f32 smoothness;
+	glm::vec3 emissive;
+	u32 albedoTextureIdx;
+	u32 emissiveTextureIdx;
+	u32 specularTextureIdx;
+	u32 normalsTextureIdx;
+	u32 bumpTextureIdx;
+};
+
+enum MaterialTexture
+{
+	MaterialTexture_Albedo,
+	MaterialTexture_Emissive,
+	MaterialTexture_Specular,
+	MaterialTexture_Normals,
+	MaterialTexture_Bump,
+	MaterialTexture_Count
+};
+
+// Texture files referenced by a material, empty when the material has none of that type
+struct MaterialTexturePaths
+{
+	std::string paths[MaterialTexture_Count];
 };
\ No newline at end of file
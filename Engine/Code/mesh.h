@@ -2,14 +2,59 @@
 
 #include "engine.h"
 #include "vertex.h"
+#include "culling.h"
+
+// Levels of detail generated per submesh at import, LOD 0 is the full mesh
+#define MESH_MAX_LODS 4
+
+// Range of the submesh indices drawn at one LOD. All the LODs share the vertices.
+struct SubmeshLod
+{
+	u32 firstIndex;
+	u32 indexCount;
+	f32 error; // object space distance to LOD 0, as estimated by the simplifier
+};
+
+// Clusters of LOD 0 triangles, small enough for their bounds to be tight
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+/**
+ * A run of consecutive LOD 0 triangles. The cone holds every triangle normal: seen from
+ * inside the region where the cone test passes, the whole meshlet faces away.
+ */
+struct Meshlet
+{
+	u32 firstIndex; // relative to the submesh indices
+	u32 indexCount;
+	BoundingSphere sphere; // object space
+	glm::vec3 coneAxis;
+	f32 coneCutoff; // sine of the cone angle, 1 when the normals spread too much to cull
+};
 
 struct Submesh
 {
+	// The geometry only lives in the mesh buffers, the CPU copy is dropped after the upload
 	VertexBufferLayout vertexBufferLayout;
-	std::vector<float> vertices;
-	std::vector<u32> indices;
-	u32 vertexOffset;
-	u32 indexOffset;
+	u32 vertexCount; // quantized, see QuantizeVertices
+	u32 indexCount; // every LOD back to back, LOD 0 first
+	GLenum indexType; // GL_UNSIGNED_SHORT when 16 bits are enough
+	u32 vertexOffset; // bytes
+	u32 indexOffset; // bytes
+
+	SubmeshLod lods[MESH_MAX_LODS];
+	u32 lodCount;
+
+	// Empty when LOD 0 fits in a single meshlet
+	std::vector<Meshlet> meshlets;
+
+	// Object space bounds
+	Aabb aabb;
+	BoundingSphere sphere;
+
+	// Location inside the shared geometry arena
+	u32 arenaBaseVertex;
+	u32 arenaFirstIndex;
 
 	std::vector<Vao> vaos;
 };
@@ -19,4 +64,46 @@ struct Mesh
 	std::vector<Submesh> submeshes;
 	GLuint vertexBufferHandle;
 	GLuint indexBufferHandle;
+
+	// Object space bounds enclosing all the submeshes
+	Aabb aabb;
+	BoundingSphere sphere;
+
+	// Quantized positions map back to object space with offset + position * scale, which
+	// GetMeshDequantization folds into the world matrix
+	glm::vec3 positionOffset;
+	f32 positionScale;
+
+	// Largest error of the submesh LODs at each level, submeshes with fewer levels count
+	// with their last one. Entities pick a level for all their submeshes.
+	f32 lodErrors[MESH_MAX_LODS];
+	u32 lodCount;
+};
+
+// All the meshes merged into one vertex and one index buffer so they can be drawn with
+// a single multi-draw. Vertices are stored with a fixed layout (see ArenaVertex) and
+// indices stay local to their submesh, the commands add the base vertex.
+struct ArenaVertex
+{
+	u16 position[4]; // unorm16 relative to the mesh bounds, like the mesh buffers
+	u32 normal;      // snorm 2_10_10_10
+	u32 texCoord;    // half2
+};
+
+struct GeometryArena
+{
+	GLuint vertexBufferHandle;
+	GLuint indexBufferHandle;
+	u32 vertexCapacity;
+	u32 vertexCount;
+	u32 indexCapacity;
+	u32 indexCount;
+
+	// Per instance attribute holding 0..N-1, it turns the base instance of each
+	// command into a draw id the shader can use
+	GLuint drawIdBufferHandle;
+	u32 drawIdCapacity;
+
+	GLuint vao;
+	bool vaoDirty;
 };
\ No newline at end of file
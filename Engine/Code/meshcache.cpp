@@ -0,0 +1,269 @@
+#include "meshcache.h"
+
+std::string GetMeshCachePath(const char* filename)
+{
+    return std::string(filename) + ".cooked";
+}
+
+u64 HashMeshSource(const MappedFile& source, u32 importFlags)
+{
+    u64 hash = HashBytes(source.data, source.size);
+    return HashBytes(&importFlags, sizeof(importFlags), hash);
+}
+
+static const char* GetCookedString(const MeshCacheHeader* header, const u8* data, u32 offset)
+{
+    if (offset == MESH_CACHE_NO_STRING || offset >= header->stringsSize)
+        return NULL;
+    return (const char*)(data + header->stringsOffset + offset);
+}
+
+static bool ValidateMeshCache(const MappedFile& file, u64 sourceHash, u32 importFlags)
+{
+    if (file.size < sizeof(MeshCacheHeader))
+        return false;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)file.data;
+    if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+        header->sourceHash != sourceHash || header->importFlags != importFlags)
+        return false;
+
+    const u64 tablesSize = sizeof(MeshCacheHeader) +
+        (u64)header->submeshCount * sizeof(CookedSubmesh) +
+        (u64)header->materialCount * sizeof(CookedMaterial) +
+        (u64)header->meshletCount * sizeof(Meshlet);
+    if (tablesSize > header->stringsOffset ||
+        (u64)header->stringsOffset + header->stringsSize > file.size ||
+        (u64)header->vertexDataOffset + header->vertexDataSize > file.size ||
+        (u64)header->indexDataOffset + header->indexDataSize > file.size)
+        return false;
+
+    // every string must be terminated inside the table
+    if (header->stringsSize > 0 && file.data[header->stringsOffset + header->stringsSize - 1] != '\0')
+        return false;
+
+    const CookedSubmesh* submeshes = (const CookedSubmesh*)(file.data + sizeof(MeshCacheHeader));
+    const Meshlet* meshlets = (const Meshlet*)((const CookedMaterial*)(submeshes + header->submeshCount) + header->materialCount);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& submesh = submeshes[i];
+        if ((u64)submesh.vertexOffset + submesh.vertexSize > header->vertexDataSize ||
+            (submesh.indexType != GL_UNSIGNED_SHORT && submesh.indexType != GL_UNSIGNED_INT) ||
+            (u64)submesh.indexOffset + (u64)submesh.indexCount * GetIndexSize(submesh.indexType) > header->indexDataSize ||
+            submesh.attributeCount > MESH_CACHE_MAX_ATTRIBUTES ||
+            submesh.materialIndex >= header->materialCount ||
+            submesh.lodCount == 0 || submesh.lodCount > MESH_MAX_LODS ||
+            (u64)submesh.firstMeshlet + submesh.meshletCount > header->meshletCount)
+            return false;
+
+        for (u32 j = 0; j < submesh.lodCount; ++j)
+            if ((u64)submesh.lods[j].firstIndex + submesh.lods[j].indexCount > submesh.indexCount)
+                return false;
+
+        for (u32 j = submesh.firstMeshlet; j < submesh.firstMeshlet + submesh.meshletCount; ++j)
+            if ((u64)meshlets[j].firstIndex + meshlets[j].indexCount > submesh.lods[0].indexCount)
+                return false;
+    }
+
+    return true;
+}
+
+bool ReadMeshCache(const char* filename, u64 sourceHash, u32 importFlags, ImportedModel& model)
+{
+    const std::string cachePath = GetMeshCachePath(filename);
+
+    MappedFile file = MapFile(cachePath.c_str());
+    if (!file.data)
+        return false;
+
+    if (!ValidateMeshCache(file, sourceHash, importFlags))
+    {
+        ILOG("Cooked mesh %s is out of date", cachePath.c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)file.data;
+    const CookedSubmesh* cookedSubmeshes = (const CookedSubmesh*)(file.data + sizeof(MeshCacheHeader));
+    const CookedMaterial* cookedMaterials = (const CookedMaterial*)(cookedSubmeshes + header->submeshCount);
+    const Meshlet* meshlets = (const Meshlet*)(cookedMaterials + header->materialCount);
+
+    model.cookedFile = file;
+    model.vertexData = file.data + header->vertexDataOffset;
+    model.vertexDataSize = header->vertexDataSize;
+    model.indexData = file.data + header->indexDataOffset;
+    model.indexDataSize = header->indexDataSize;
+
+    model.materials.resize(header->materialCount);
+    model.texturePaths.resize(header->materialCount);
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const CookedMaterial& cookedMaterial = cookedMaterials[i];
+        const char* name = GetCookedString(header, file.data, cookedMaterial.nameOffset);
+
+        Material& material = model.materials[i];
+        material.name = name ? name : "";
+        material.albedo = cookedMaterial.albedo;
+        material.emissive = cookedMaterial.emissive;
+        material.smoothness = cookedMaterial.smoothness;
+
+        for (u32 j = 0; j < MaterialTexture_Count; ++j)
+        {
+            const char* path = GetCookedString(header, file.data, cookedMaterial.textureOffsets[j]);
+            if (path)
+                model.texturePaths[i].paths[j] = path;
+        }
+    }
+
+    Mesh& mesh = model.mesh;
+    mesh.aabb = header->aabb;
+    mesh.sphere = header->sphere;
+    mesh.positionOffset = header->positionOffset;
+    mesh.positionScale = header->positionScale;
+    mesh.submeshes.resize(header->submeshCount);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& cookedSubmesh = cookedSubmeshes[i];
+        Submesh& submesh = mesh.submeshes[i];
+
+        for (u32 j = 0; j < cookedSubmesh.attributeCount; ++j)
+        {
+            const CookedAttribute& attribute = cookedSubmesh.attributes[j];
+            submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ attribute.location, attribute.componentCount, attribute.offset, attribute.type });
+        }
+        submesh.vertexBufferLayout.stride = cookedSubmesh.stride;
+
+        submesh.vertexCount = cookedSubmesh.stride > 0 ? cookedSubmesh.vertexSize / cookedSubmesh.stride : 0;
+        submesh.indexCount = cookedSubmesh.indexCount;
+        submesh.indexType = cookedSubmesh.indexType;
+        submesh.vertexOffset = cookedSubmesh.vertexOffset;
+        submesh.indexOffset = cookedSubmesh.indexOffset;
+        submesh.lodCount = cookedSubmesh.lodCount;
+        for (u32 j = 0; j < cookedSubmesh.lodCount; ++j)
+            submesh.lods[j] = cookedSubmesh.lods[j];
+        submesh.meshlets.assign(meshlets + cookedSubmesh.firstMeshlet, meshlets + cookedSubmesh.firstMeshlet + cookedSubmesh.meshletCount);
+        submesh.aabb = cookedSubmesh.aabb;
+        submesh.sphere = cookedSubmesh.sphere;
+
+        model.submeshMaterials.push_back(cookedSubmesh.materialIndex);
+    }
+    UpdateMeshLodErrors(mesh);
+
+    return true;
+}
+
+static u32 AddCookedString(std::vector<char>& strings, const std::string& str)
+{
+    u32 offset = (u32)strings.size();
+    strings.insert(strings.end(), str.begin(), str.end());
+    strings.push_back('\0');
+    return offset;
+}
+
+bool WriteMeshCache(const char* filename, u64 sourceHash, u32 importFlags, const ImportedModel& model)
+{
+    const Mesh& mesh = model.mesh;
+    const u32 materialCount = (u32)model.materials.size();
+
+    std::vector<CookedSubmesh> cookedSubmeshes(mesh.submeshes.size());
+    std::vector<CookedMaterial> cookedMaterials(materialCount);
+    std::vector<Meshlet> meshlets;
+    std::vector<char> strings;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        CookedSubmesh& cookedSubmesh = cookedSubmeshes[i];
+        cookedSubmesh = CookedSubmesh{};
+
+        if (submesh.vertexBufferLayout.attributes.size() > MESH_CACHE_MAX_ATTRIBUTES)
+        {
+            ELOG("Can't cook mesh %s: too many vertex attributes", filename);
+            return false;
+        }
+
+        cookedSubmesh.vertexOffset = submesh.vertexOffset;
+        cookedSubmesh.vertexSize = submesh.vertexCount * submesh.vertexBufferLayout.stride;
+        cookedSubmesh.indexOffset = submesh.indexOffset;
+        cookedSubmesh.indexCount = submesh.indexCount;
+        cookedSubmesh.indexType = submesh.indexType;
+        cookedSubmesh.materialIndex = model.submeshMaterials[i];
+        cookedSubmesh.attributeCount = (u8)submesh.vertexBufferLayout.attributes.size();
+        cookedSubmesh.stride = submesh.vertexBufferLayout.stride;
+        for (u32 j = 0; j < cookedSubmesh.attributeCount; ++j)
+        {
+            const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+            cookedSubmesh.attributes[j] = CookedAttribute{ attribute.location, attribute.componentCount, attribute.offset, attribute.type };
+        }
+        cookedSubmesh.lodCount = submesh.lodCount;
+        for (u32 j = 0; j < submesh.lodCount; ++j)
+            cookedSubmesh.lods[j] = submesh.lods[j];
+        cookedSubmesh.firstMeshlet = (u32)meshlets.size();
+        cookedSubmesh.meshletCount = (u32)submesh.meshlets.size();
+        meshlets.insert(meshlets.end(), submesh.meshlets.begin(), submesh.meshlets.end());
+        cookedSubmesh.aabb = submesh.aabb;
+        cookedSubmesh.sphere = submesh.sphere;
+    }
+
+    for (u32 i = 0; i < materialCount; ++i)
+    {
+        const Material& material = model.materials[i];
+        CookedMaterial& cookedMaterial = cookedMaterials[i];
+        cookedMaterial.nameOffset = AddCookedString(strings, material.name);
+        cookedMaterial.albedo = material.albedo;
+        cookedMaterial.emissive = material.emissive;
+        cookedMaterial.smoothness = material.smoothness;
+        for (u32 j = 0; j < MaterialTexture_Count; ++j)
+        {
+            const std::string& path = model.texturePaths[i].paths[j];
+            cookedMaterial.textureOffsets[j] = path.empty() ? MESH_CACHE_NO_STRING : AddCookedString(strings, path);
+        }
+    }
+
+    // keep the blobs 4 byte aligned so the mapped indices can be read in place
+    while (strings.size() % 4 != 0)
+        strings.push_back('\0');
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.importFlags = importFlags;
+    header.submeshCount = (u32)cookedSubmeshes.size();
+    header.materialCount = materialCount;
+    header.meshletCount = (u32)meshlets.size();
+    const u32 meshletsOffset = (u32)(sizeof(MeshCacheHeader) + cookedSubmeshes.size() * sizeof(CookedSubmesh) + cookedMaterials.size() * sizeof(CookedMaterial));
+    header.stringsOffset = meshletsOffset + (u32)(meshlets.size() * sizeof(Meshlet));
+    header.stringsSize = (u32)strings.size();
+    header.vertexDataOffset = header.stringsOffset + header.stringsSize;
+    header.vertexDataSize = model.vertexDataSize;
+    header.indexDataOffset = header.vertexDataOffset + model.vertexDataSize;
+    header.indexDataSize = model.indexDataSize;
+    header.aabb = mesh.aabb;
+    header.sphere = mesh.sphere;
+    header.positionOffset = mesh.positionOffset;
+    header.positionScale = mesh.positionScale;
+
+    std::vector<u8> data(header.indexDataOffset + model.indexDataSize);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), cookedSubmeshes.data(), cookedSubmeshes.size() * sizeof(CookedSubmesh));
+    memcpy(data.data() + sizeof(header) + cookedSubmeshes.size() * sizeof(CookedSubmesh), cookedMaterials.data(), cookedMaterials.size() * sizeof(CookedMaterial));
+    if (!meshlets.empty())
+        memcpy(data.data() + meshletsOffset, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+    if (!strings.empty())
+        memcpy(data.data() + header.stringsOffset, strings.data(), strings.size());
+
+    if (model.vertexDataSize > 0)
+        memcpy(data.data() + header.vertexDataOffset, model.vertexData, model.vertexDataSize);
+    if (model.indexDataSize > 0)
+        memcpy(data.data() + header.indexDataOffset, model.indexData, model.indexDataSize);
+
+    const std::string cachePath = GetMeshCachePath(filename);
+    if (!WriteBinaryFile(cachePath.c_str(), data.data(), data.size()))
+    {
+        ELOG("Can't write cooked mesh %s", cachePath.c_str());
+        return false;
+    }
+
+    return true;
+}
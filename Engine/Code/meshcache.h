@@ -0,0 +1,108 @@
+#pragma once
+
+#include "engine.h"
+#include "meshopt.h"
+
+// Cooked models are stored next to their source as "<source>.cooked". A cooked file is
+// only used if it was made from a source with the same content hash and with the same
+// import flags, anything else (including a different version) falls back to Assimp.
+#define MESH_CACHE_MAGIC 0x4b4f4f43u // "COOK"
+#define MESH_CACHE_VERSION 5
+#define MESH_CACHE_NO_STRING 0xffffffffu
+#define MESH_CACHE_MAX_ATTRIBUTES 8
+
+// File layout: header, submeshes, materials, meshlets, string table, vertex blob, index blob.
+// Offsets in the header are from the start of the file, offsets in the submeshes are
+// from the start of their blob.
+struct MeshCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u64 sourceHash;
+	u32 importFlags;
+	u32 submeshCount;
+	u32 materialCount;
+	u32 meshletCount;
+	u32 stringsOffset;
+	u32 stringsSize;
+	u32 vertexDataOffset;
+	u32 vertexDataSize;
+	u32 indexDataOffset;
+	u32 indexDataSize;
+	Aabb aabb;
+	BoundingSphere sphere;
+	glm::vec3 positionOffset;
+	f32 positionScale;
+};
+
+struct CookedAttribute
+{
+	u8 location;
+	u8 componentCount;
+	u8 offset;
+	u8 type;
+};
+
+struct CookedSubmesh
+{
+	u32 vertexOffset;
+	u32 vertexSize;
+	u32 indexOffset;
+	u32 indexCount;
+	u32 indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, as stored in the blob
+	u32 materialIndex; // relative to the first material of the model
+	u8 attributeCount;
+	u8 stride;
+	u8 padding[2];
+	CookedAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+	u32 lodCount;
+	SubmeshLod lods[MESH_MAX_LODS]; // ranges of the indices above
+	u32 firstMeshlet; // in the meshlet table
+	u32 meshletCount;
+	Aabb aabb;
+	BoundingSphere sphere;
+};
+
+struct CookedMaterial
+{
+	u32 nameOffset;
+	glm::vec3 albedo;
+	glm::vec3 emissive;
+	f32 smoothness;
+	u32 textureOffsets[MaterialTexture_Count]; // MESH_CACHE_NO_STRING if unused
+};
+
+// CPU side result of importing a model, built on any thread and uploaded on the GL thread
+struct ImportedModel
+{
+	Mesh mesh; // no GL handles yet, the submesh buffer offsets are already set
+	std::vector<u32> submeshMaterials; // relative to the first material of the model
+	std::vector<Material> materials; // textures are not loaded yet
+	std::vector<MaterialTexturePaths> texturePaths;
+	u64 sourceHash;
+
+	// Vertex and index blobs laid out exactly as the mesh buffers. They point into the
+	// cooked file, which stays mapped until the upload, or into the storage of a fresh
+	// import. Either way they go away with the ImportedModel once uploaded.
+	MappedFile cookedFile;
+	std::vector<u8> vertexStorage;
+	std::vector<u8> indexStorage;
+	const u8* vertexData;
+	u32 vertexDataSize;
+	const u8* indexData;
+	u32 indexDataSize;
+};
+
+std::string GetMeshCachePath(const char* filename);
+
+// Hash of the source file contents combined with the import flags
+u64 HashMeshSource(const MappedFile& source, u32 importFlags);
+
+/**
+ * Fills the model from its cooked file and leaves the file mapped. Returns false if
+ * there is no valid cooked file for this source hash and import flags. Thread safe.
+ */
+bool ReadMeshCache(const char* filename, u64 sourceHash, u32 importFlags, ImportedModel& model);
+
+// Writes the cooked file of a model imported with Assimp. Thread safe.
+bool WriteMeshCache(const char* filename, u64 sourceHash, u32 importFlags, const ImportedModel& model);
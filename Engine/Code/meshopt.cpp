@@ -0,0 +1,691 @@
+#include "meshopt.h"
+
+#include <algorithm>
+#include <numeric>
+
+u32 CountVertexTransforms(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize)
+{
+    // A vertex is in the cache if it entered it less than cacheSize misses ago
+    std::vector<u32> cacheTimestamps(vertexCount, 0);
+    u32 timestamp = cacheSize + 1;
+    u32 transforms = 0;
+
+    for (u32 i = 0; i < indexCount; ++i)
+    {
+        const u32 v = indices[i];
+        if (timestamp - cacheTimestamps[v] > cacheSize)
+        {
+            cacheTimestamps[v] = timestamp++;
+            transforms++;
+        }
+    }
+
+    return transforms;
+}
+
+void OptimizeVertexCache(std::vector<u32>& indices, u32 vertexCount, u32 cacheSize, std::vector<u32>& clusterStarts)
+{
+    const u32 triangleCount = (u32)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles adjacent to each vertex, as ranges of one array
+    std::vector<u32> liveTriangles(vertexCount, 0);
+    for (u32 i = 0; i < indices.size(); ++i)
+        liveTriangles[indices[i]]++;
+
+    std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+    for (u32 v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<u32> adjacency(indices.size());
+    std::vector<u32> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (u32 t = 0; t < triangleCount; ++t)
+        for (u32 k = 0; k < 3; ++k)
+            adjacency[adjacencyFill[indices[t * 3 + k]]++] = t;
+
+    std::vector<u32> cacheTimestamps(vertexCount, 0);
+    std::vector<u8> emitted(triangleCount, 0);
+    std::vector<u32> deadEnds;
+    std::vector<u32> candidates;
+    std::vector<u32> output;
+    output.reserve(indices.size());
+
+    u32 timestamp = cacheSize + 1;
+    u32 cursor = 0;
+    i64 fanningVertex = 0;
+    bool discontinuity = true;
+
+    while (fanningVertex >= 0)
+    {
+        const u32 f = (u32)fanningVertex;
+        candidates.clear();
+
+        for (u32 a = adjacencyOffsets[f]; a < adjacencyOffsets[f + 1]; ++a)
+        {
+            const u32 t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            if (discontinuity)
+            {
+                clusterStarts.push_back((u32)output.size() / 3);
+                discontinuity = false;
+            }
+
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (timestamp - cacheTimestamps[v] > cacheSize)
+                    cacheTimestamps[v] = timestamp++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Next fanning vertex: the candidate that stays in the cache the longest while
+        // its remaining triangles are emitted
+        i64 best = -1;
+        u32 bestPriority = 0;
+        for (u32 c = 0; c < candidates.size(); ++c)
+        {
+            const u32 v = candidates[c];
+            if (liveTriangles[v] == 0)
+                continue;
+
+            u32 priority = 0;
+            if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timestamp - cacheTimestamps[v];
+            if (best < 0 || priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        if (best < 0)
+        {
+            // Dead end: go back to a recently used vertex, otherwise scan for any vertex
+            // with triangles left, which is where the cache contents stop mattering
+            while (!deadEnds.empty() && best < 0)
+            {
+                const u32 v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    best = v;
+            }
+
+            while (best < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0)
+                {
+                    best = cursor;
+                    discontinuity = true;
+                }
+                cursor++;
+            }
+        }
+
+        fanningVertex = best;
+    }
+
+    indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<u32>& indices, const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset,
+                      const std::vector<u32>& clusterStarts)
+{
+    const u32 triangleCount = (u32)indices.size() / 3;
+    const u32 clusterCount = (u32)clusterStarts.size();
+    if (clusterCount < 2)
+        return;
+
+    struct Cluster
+    {
+        u32 firstTriangle;
+        u32 triangleCount;
+        f32 sortKey;
+    };
+
+    const f32* positions = vertices.data() + positionOffset;
+    glm::vec3 meshCentroid(0.0f);
+    f32 meshArea = 0.0f;
+
+    std::vector<Cluster> clusters(clusterCount);
+    std::vector<glm::vec3> clusterCentroids(clusterCount);
+    std::vector<glm::vec3> clusterNormals(clusterCount);
+    for (u32 c = 0; c < clusterCount; ++c)
+    {
+        Cluster& cluster = clusters[c];
+        cluster.firstTriangle = clusterStarts[c];
+        cluster.triangleCount = (c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount) - cluster.firstTriangle;
+
+        // Area weighted centroid and normal
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        f32 area = 0.0f;
+        for (u32 t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.triangleCount; ++t)
+        {
+            const f32* p0 = positions + indices[t * 3 + 0] * floatStride;
+            const f32* p1 = positions + indices[t * 3 + 1] * floatStride;
+            const f32* p2 = positions + indices[t * 3 + 2] * floatStride;
+            const glm::vec3 a(p0[0], p0[1], p0[2]);
+            const glm::vec3 b(p1[0], p1[1], p1[2]);
+            const glm::vec3 d(p2[0], p2[1], p2[2]);
+            const glm::vec3 crossProduct = glm::cross(b - a, d - a);
+            const f32 triangleArea = glm::length(crossProduct);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += crossProduct;
+            area += triangleArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+        clusterCentroids[c] = area > 0.0f ? centroid / area : centroid;
+        clusterNormals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for (u32 c = 0; c < clusterCount; ++c)
+        clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<u32> output;
+    output.reserve(indices.size());
+    for (u32 c = 0; c < clusterCount; ++c)
+        output.insert(output.end(), indices.begin() + clusters[c].firstTriangle * 3,
+            indices.begin() + (clusters[c].firstTriangle + clusters[c].triangleCount) * 3);
+    indices.swap(output);
+}
+
+u32 OptimizeVertexFetch(std::vector<f32>& vertices, u32 floatStride, std::vector<u32>& indices)
+{
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    std::vector<u32> remap(vertexCount, UINT32_MAX);
+    std::vector<f32> output;
+    output.reserve(vertices.size());
+
+    u32 newVertexCount = 0;
+    for (u32 i = 0; i < indices.size(); ++i)
+    {
+        const u32 v = indices[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = newVertexCount++;
+            output.insert(output.end(), vertices.begin() + v * floatStride, vertices.begin() + (v + 1) * floatStride);
+        }
+        indices[i] = remap[v];
+    }
+
+    vertices.swap(output);
+    return newVertexCount;
+}
+
+void OptimizeMesh(std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, std::vector<u32>& indices,
+                  MeshOptimizationStats& stats)
+{
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    const u32 transformsBefore = CountVertexTransforms(indices.data(), (u32)indices.size(), vertexCount, MESH_OPT_CACHE_SIZE);
+
+    std::vector<u32> clusterStarts;
+    OptimizeVertexCache(indices, vertexCount, MESH_OPT_CACHE_SIZE, clusterStarts);
+    OptimizeOverdraw(indices, vertices, floatStride, positionOffset, clusterStarts);
+    const u32 newVertexCount = OptimizeVertexFetch(vertices, floatStride, indices);
+
+    stats.triangleCount += (u32)indices.size() / 3;
+    stats.vertexCount += newVertexCount;
+    stats.transformsBefore += transformsBefore;
+    stats.transformsAfter += CountVertexTransforms(indices.data(), (u32)indices.size(), newVertexCount, MESH_OPT_CACHE_SIZE);
+}
+
+// Sum of squared distances to planes, weighted by the area of the triangles they come from
+struct Quadric
+{
+    f32 a00, a11, a22, a01, a12, a02;
+    f32 b0, b1, b2;
+    f32 c;
+    f32 weight;
+};
+
+static void AddPlaneQuadric(Quadric& q, const glm::vec3& normal, f32 distance, f32 weight)
+{
+    q.a00 += weight * normal.x * normal.x;
+    q.a11 += weight * normal.y * normal.y;
+    q.a22 += weight * normal.z * normal.z;
+    q.a01 += weight * normal.x * normal.y;
+    q.a12 += weight * normal.y * normal.z;
+    q.a02 += weight * normal.x * normal.z;
+    q.b0 += weight * normal.x * distance;
+    q.b1 += weight * normal.y * distance;
+    q.b2 += weight * normal.z * distance;
+    q.c += weight * distance * distance;
+    q.weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a11 += other.a11;
+    q.a22 += other.a22;
+    q.a01 += other.a01;
+    q.a12 += other.a12;
+    q.a02 += other.a02;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// Mean squared distance from p to the planes of the quadric
+static f32 EvaluateQuadric(const Quadric& q, const glm::vec3& p)
+{
+    const f32 ax = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+    const f32 ay = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+    const f32 az = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+    const f32 error = p.x * ax + p.y * ay + p.z * az + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+    return q.weight > 0.0f ? glm::abs(error) / q.weight : 0.0f;
+}
+
+struct EdgeCollapse
+{
+    u32 source;
+    u32 target;
+    f32 error;
+};
+
+// Triangles whose normal turns by more than ~75 degrees when the source moves onto the
+// target would fold over their neighbors
+static bool CollapseFlipsTriangles(const std::vector<glm::vec3>& positions, const std::vector<u32>& positionRemap,
+                                   const std::vector<u32>& collapseRemap, const std::vector<u32>& indices,
+                                   const u32* triangles, u32 triangleCount, u32 source, u32 target)
+{
+    const glm::vec3& targetPosition = positions[target];
+
+    for (u32 i = 0; i < triangleCount; ++i)
+    {
+        const u32 t = triangles[i];
+        u32 corners[3];
+        for (u32 k = 0; k < 3; ++k)
+            corners[k] = collapseRemap[indices[t * 3 + k]];
+
+        // The triangles on the collapsed edge disappear
+        if (positionRemap[corners[0]] == positionRemap[target] || positionRemap[corners[1]] == positionRemap[target] ||
+            positionRemap[corners[2]] == positionRemap[target])
+            continue;
+
+        glm::vec3 p[3] = { positions[corners[0]], positions[corners[1]], positions[corners[2]] };
+        const glm::vec3 oldNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (u32 k = 0; k < 3; ++k)
+            if (corners[k] == source)
+                p[k] = targetPosition;
+        const glm::vec3 newNormal = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+        if (glm::dot(oldNormal, newNormal) < 0.25f * glm::length(oldNormal) * glm::length(newNormal))
+            return true;
+    }
+
+    return false;
+}
+
+f32 SimplifyMesh(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, const std::vector<u32>& indices,
+                 u32 targetIndexCount, std::vector<u32>& result)
+{
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    result = indices;
+    if (indices.size() <= targetIndexCount || vertexCount == 0)
+        return 0.0f;
+
+    // Positions in the unit box so the thresholds don't depend on the size of the model
+    std::vector<glm::vec3> positions(vertexCount);
+    Aabb aabb = MakeEmptyAabb();
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const f32* p = vertices.data() + v * floatStride + positionOffset;
+        positions[v] = glm::vec3(p[0], p[1], p[2]);
+        GrowAabb(aabb, positions[v]);
+    }
+    const glm::vec3 extent = aabb.max - aabb.min;
+    const f32 scale = glm::max(extent.x, glm::max(extent.y, extent.z));
+    if (scale <= 0.0f)
+        return 0.0f;
+
+    // Vertices at the same position (split by their normal or uv) share one canonical
+    // vertex, which holds the quadric and decides whether they can move
+    std::vector<u32> sortedVertices(vertexCount);
+    std::iota(sortedVertices.begin(), sortedVertices.end(), 0);
+    std::sort(sortedVertices.begin(), sortedVertices.end(), [&positions](u32 a, u32 b) {
+        const glm::vec3& pa = positions[a];
+        const glm::vec3& pb = positions[b];
+        return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+    });
+
+    std::vector<u32> positionRemap(vertexCount);
+    std::vector<u32> wedgeCounts(vertexCount, 0);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const u32 v = sortedVertices[i];
+        const u32 previous = i > 0 ? sortedVertices[i - 1] : v;
+        positionRemap[v] = i > 0 && positions[v] == positions[previous] ? positionRemap[previous] : v;
+        wedgeCounts[positionRemap[v]]++;
+    }
+
+    for (u32 v = 0; v < vertexCount; ++v)
+        positions[v] = (positions[v] - aabb.min) / scale;
+
+    // An edge without its opposite half edge is on an open border
+    std::vector<u32> edgeOffsets(vertexCount + 1, 0);
+    for (u32 i = 0; i < indices.size(); ++i)
+        edgeOffsets[positionRemap[indices[i]] + 1]++;
+    for (u32 v = 0; v < vertexCount; ++v)
+        edgeOffsets[v + 1] += edgeOffsets[v];
+
+    std::vector<u32> edgeTargets(indices.size());
+    std::vector<u32> edgeFill(edgeOffsets.begin(), edgeOffsets.end() - 1);
+    for (u32 i = 0; i < indices.size(); ++i)
+    {
+        const u32 next = i % 3 == 2 ? i - 2 : i + 1;
+        edgeTargets[edgeFill[positionRemap[indices[i]]]++] = positionRemap[indices[next]];
+    }
+
+    std::vector<u8> locked(vertexCount, 0);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        if (wedgeCounts[v] > 1)
+            locked[v] = 1;
+
+        for (u32 e = edgeOffsets[v]; e < edgeOffsets[v + 1]; ++e)
+        {
+            const u32 w = edgeTargets[e];
+            if (std::find(edgeTargets.begin() + edgeOffsets[w], edgeTargets.begin() + edgeOffsets[w + 1], v) == edgeTargets.begin() + edgeOffsets[w + 1])
+                locked[v] = locked[w] = 1;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    for (u32 t = 0; t < indices.size() / 3; ++t)
+    {
+        const glm::vec3& p0 = positions[indices[t * 3 + 0]];
+        const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+        const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const f32 length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+
+        normal /= length;
+        const f32 distance = -glm::dot(normal, p0);
+        for (u32 k = 0; k < 3; ++k)
+            AddPlaneQuadric(quadrics[positionRemap[indices[t * 3 + k]]], normal, distance, length * 0.5f);
+    }
+
+    std::vector<EdgeCollapse> collapses;
+    std::vector<u32> collapseRemap(vertexCount);
+    std::vector<u8> collapseLocked(vertexCount);
+    std::vector<u32> triangleOffsets(vertexCount + 1);
+    std::vector<u32> triangles;
+    std::vector<u32> triangleFill;
+    f32 maxError = 0.0f;
+
+    // Every pass collapses the cheapest edges that don't touch each other, and stops at
+    // the collapses it needs to reach the target
+    while (result.size() > targetIndexCount)
+    {
+        const u32 triangleCount = (u32)result.size() / 3;
+
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (u32 i = 0; i < result.size(); ++i)
+            triangleOffsets[result[i] + 1]++;
+        for (u32 v = 0; v < vertexCount; ++v)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        triangles.resize(result.size());
+        triangleFill.assign(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (u32 i = 0; i < result.size(); ++i)
+            triangles[triangleFill[result[i]]++] = i / 3;
+
+        collapses.clear();
+        for (u32 i = 0; i < result.size(); ++i)
+        {
+            const u32 source = result[i];
+            const u32 target = result[i % 3 == 2 ? i - 2 : i + 1];
+            if (locked[positionRemap[source]] || positionRemap[source] == positionRemap[target])
+                continue;
+
+            EdgeCollapse collapse = { source, target, EvaluateQuadric(quadrics[positionRemap[source]], positions[target]) };
+            collapses.push_back(collapse);
+        }
+
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b) { return a.error < b.error; });
+
+        std::iota(collapseRemap.begin(), collapseRemap.end(), 0);
+        std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+
+        // An interior collapse removes two triangles
+        const u32 triangleGoal = triangleCount - (u32)targetIndexCount / 3;
+        u32 removedTriangles = 0;
+        for (u32 c = 0; c < collapses.size() && removedTriangles < triangleGoal; ++c)
+        {
+            const EdgeCollapse& collapse = collapses[c];
+            const u32 source = positionRemap[collapse.source];
+            const u32 target = positionRemap[collapse.target];
+            if (collapseLocked[source] || collapseLocked[target])
+                continue;
+
+            const u32 firstTriangle = triangleOffsets[collapse.source];
+            if (CollapseFlipsTriangles(positions, positionRemap, collapseRemap, result, triangles.data() + firstTriangle,
+                    triangleOffsets[collapse.source + 1] - firstTriangle, collapse.source, collapse.target))
+                continue;
+
+            collapseRemap[collapse.source] = collapse.target;
+            AddQuadric(quadrics[target], quadrics[source]);
+            collapseLocked[source] = 1;
+            collapseLocked[target] = 1;
+            maxError = glm::max(maxError, collapse.error);
+            removedTriangles += 2;
+        }
+
+        if (removedTriangles == 0)
+            break;
+
+        u32 write = 0;
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            const u32 a = collapseRemap[result[t * 3 + 0]];
+            const u32 b = collapseRemap[result[t * 3 + 1]];
+            const u32 d = collapseRemap[result[t * 3 + 2]];
+            if (positionRemap[a] == positionRemap[b] || positionRemap[b] == positionRemap[d] || positionRemap[a] == positionRemap[d])
+                continue;
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = d;
+        }
+        result.resize(write);
+    }
+
+    return glm::sqrt(maxError) * scale;
+}
+
+u32 GenerateLods(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, std::vector<u32>& indices,
+                 SubmeshLod* lods, MeshOptimizationStats& stats)
+{
+    // A level that keeps more than this fraction of the previous one isn't worth drawing
+    const f32 minReduction = 0.8f;
+
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    const u32 triangleCount = (u32)indices.size() / 3;
+
+    lods[0] = SubmeshLod{ 0, (u32)indices.size(), 0.0f };
+    stats.lodTriangleCounts[0] += triangleCount;
+
+    // Each level simplifies the previous one, so their errors add up
+    std::vector<u32> source = indices;
+    std::vector<u32> simplified;
+    std::vector<u32> clusterStarts;
+    f32 error = 0.0f;
+    u32 lodCount = 1;
+    while (lodCount < MESH_MAX_LODS)
+    {
+        const u32 targetIndexCount = (triangleCount >> lodCount) * 3;
+        error += SimplifyMesh(vertices, floatStride, positionOffset, source, targetIndexCount, simplified);
+        if (simplified.empty() || simplified.size() > source.size() * minReduction)
+            break;
+
+        clusterStarts.clear();
+        OptimizeVertexCache(simplified, vertexCount, MESH_OPT_CACHE_SIZE, clusterStarts);
+
+        lods[lodCount] = SubmeshLod{ (u32)indices.size(), (u32)simplified.size(), error };
+        stats.lodTriangleCounts[lodCount] += (u32)simplified.size() / 3;
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        source.swap(simplified);
+        lodCount++;
+    }
+
+    return lodCount;
+}
+
+static void FinishMeshlet(const std::vector<glm::vec3>& positions, const u32* indices, const std::vector<u32>& meshletVertices,
+                          Meshlet& meshlet)
+{
+    Aabb aabb = MakeEmptyAabb();
+    for (u32 i = 0; i < meshletVertices.size(); ++i)
+        GrowAabb(aabb, positions[meshletVertices[i]]);
+
+    meshlet.sphere.center = (aabb.min + aabb.max) * 0.5f;
+    meshlet.sphere.radius = 0.0f;
+    for (u32 i = 0; i < meshletVertices.size(); ++i)
+        meshlet.sphere.radius = glm::max(meshlet.sphere.radius, glm::length(positions[meshletVertices[i]] - meshlet.sphere.center));
+
+    // Average of the unit normals, then the widest angle from it to any of them
+    glm::vec3 normalSum(0.0f);
+    for (u32 i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+    {
+        const glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+        const f32 length = glm::length(normal);
+        if (length > 0.0f)
+            normalSum += normal / length;
+    }
+
+    meshlet.coneAxis = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : glm::vec3(0.0f, 0.0f, 1.0f);
+    f32 minDot = 1.0f;
+    for (u32 i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+    {
+        const glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]], positions[indices[i + 2]] - positions[indices[i]]);
+        const f32 length = glm::length(normal);
+        if (length > 0.0f)
+            minDot = glm::min(minDot, glm::dot(meshlet.coneAxis, normal / length));
+    }
+
+    // Past ~85 degrees the cone can't reject anything worth the test
+    meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : glm::sqrt(1.0f - minDot * minDot);
+}
+
+void BuildMeshlets(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, const u32* indices, u32 indexCount,
+                   std::vector<Meshlet>& meshlets)
+{
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    std::vector<glm::vec3> positions(vertexCount);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const f32* p = vertices.data() + v * floatStride + positionOffset;
+        positions[v] = glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // Vertices are marked with the number of the meshlet that last used them
+    std::vector<u32> vertexMeshlet(vertexCount, UINT32_MAX);
+    std::vector<u32> meshletVertices;
+
+    Meshlet meshlet = {};
+    for (u32 i = 0; i < indexCount; i += 3)
+    {
+        const u32 meshletNumber = (u32)meshlets.size();
+        u32 newVertices = 0;
+        for (u32 k = 0; k < 3; ++k)
+            if (vertexMeshlet[indices[i + k]] != meshletNumber)
+                newVertices++;
+
+        // The triangle starts the next meshlet when it doesn't fit
+        if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES || meshlet.indexCount / 3 == MESHLET_MAX_TRIANGLES)
+        {
+            FinishMeshlet(positions, indices, meshletVertices, meshlet);
+            meshlets.push_back(meshlet);
+            meshlet = Meshlet{};
+            meshlet.firstIndex = i;
+            meshletVertices.clear();
+        }
+
+        for (u32 k = 0; k < 3; ++k)
+        {
+            if (vertexMeshlet[indices[i + k]] != (u32)meshlets.size())
+            {
+                vertexMeshlet[indices[i + k]] = (u32)meshlets.size();
+                meshletVertices.push_back(indices[i + k]);
+            }
+        }
+        meshlet.indexCount += 3;
+    }
+
+    if (meshlet.indexCount > 0)
+    {
+        FinishMeshlet(positions, indices, meshletVertices, meshlet);
+        meshlets.push_back(meshlet);
+    }
+}
+
+bool IsMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& center, const glm::vec3& cameraPosition)
+{
+    const glm::vec3 view = center - cameraPosition;
+    return glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(view) + meshlet.sphere.radius;
+}
+
+void UpdateMeshLodErrors(Mesh& mesh)
+{
+    mesh.lodCount = 0;
+    for (u32 l = 0; l < MESH_MAX_LODS; ++l)
+        mesh.lodErrors[l] = 0.0f;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        mesh.lodCount = glm::max(mesh.lodCount, submesh.lodCount);
+        for (u32 l = 0; l < MESH_MAX_LODS && submesh.lodCount > 0; ++l)
+            mesh.lodErrors[l] = glm::max(mesh.lodErrors[l], submesh.lods[glm::min(l, submesh.lodCount - 1)].error);
+    }
+}
+
+GLenum ChooseIndexType(u32 vertexCount)
+{
+    return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+u32 GetIndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(u32);
+}
+
+void AppendIndices(const std::vector<u32>& indices, GLenum indexType, std::vector<u8>& data)
+{
+    const u32 base = (u32)data.size();
+    const u32 bytes = (u32)indices.size() * GetIndexSize(indexType);
+    data.resize(base + ((bytes + 3) & ~3u), 0);
+
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+        u16* dst = (u16*)(data.data() + base);
+        for (u32 i = 0; i < indices.size(); ++i)
+            dst[i] = (u16)indices[i];
+    }
+    else
+    {
+        memcpy(data.data() + base, indices.data(), bytes);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "engine.h"
+
+// Size of the simulated FIFO post-transform cache used to order and to measure
+#define MESH_OPT_CACHE_SIZE 16
+
+// Totals over the submeshes of a model. ACMR is transformed vertices per triangle,
+// ATVR transformed vertices per unique vertex (1.0 is optimal).
+struct MeshOptimizationStats
+{
+	u32 triangleCount;
+	u32 vertexCount;
+	u32 transformsBefore;
+	u32 transformsAfter;
+	u32 lodTriangleCounts[MESH_MAX_LODS];
+	u32 meshletCount;
+};
+
+// Counts the vertex shader invocations of the indices with a FIFO cache of cacheSize
+u32 CountVertexTransforms(const u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize);
+
+/**
+ * Tipsify (Sander et al. 2007) vertex cache ordering. Appends to clusterStarts the first
+ * triangle of each run that starts after a cache discontinuity, so the runs can be
+ * reordered without hurting the cache.
+ */
+void OptimizeVertexCache(std::vector<u32>& indices, u32 vertexCount, u32 cacheSize, std::vector<u32>& clusterStarts);
+
+/**
+ * Sorts the clusters so the ones facing away from the mesh center, which tend to occlude
+ * the rest from any viewpoint, are drawn first. positionOffset is in floats.
+ */
+void OptimizeOverdraw(std::vector<u32>& indices, const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset,
+                      const std::vector<u32>& clusterStarts);
+
+/**
+ * Reorders the vertices in the order the indices first use them and drops unused ones,
+ * so the vertex fetch walks memory linearly. Returns the new vertex count.
+ */
+u32 OptimizeVertexFetch(std::vector<f32>& vertices, u32 floatStride, std::vector<u32>& indices);
+
+// Runs the three passes above and adds the before/after numbers to stats
+void OptimizeMesh(std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, std::vector<u32>& indices,
+                  MeshOptimizationStats& stats);
+
+/**
+ * Quadric error edge collapse (Garland and Heckbert 1997) down to targetIndexCount
+ * indices or until no collapse is left. Vertices only move onto their neighbors, so the
+ * result indexes the same vertices. Vertices on open borders and on attribute seams are
+ * kept where they are. Returns the largest collapse error as an object space distance.
+ */
+f32 SimplifyMesh(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, const std::vector<u32>& indices,
+                 u32 targetIndexCount, std::vector<u32>& result);
+
+/**
+ * Appends to indices (LOD 0) up to MESH_MAX_LODS - 1 levels, each with half the triangles
+ * of the previous one, and returns how many levels there are in total. Stops early once
+ * a level would barely be smaller than the previous one.
+ */
+u32 GenerateLods(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, std::vector<u32>& indices,
+                 SubmeshLod* lods, MeshOptimizationStats& stats);
+
+/**
+ * Splits the triangles in order into meshlets of up to MESHLET_MAX_VERTICES vertices and
+ * MESHLET_MAX_TRIANGLES triangles. The indices are expected to be ordered for the vertex
+ * cache already, which keeps each run of triangles compact.
+ */
+void BuildMeshlets(const std::vector<f32>& vertices, u32 floatStride, u32 positionOffset, const u32* indices, u32 indexCount,
+                   std::vector<Meshlet>& meshlets);
+
+/**
+ * True when every triangle of the meshlet faces away from the camera. The view direction
+ * is taken to the sphere center, the radius keeps the test conservative.
+ */
+bool IsMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& center, const glm::vec3& cameraPosition);
+
+// Sets the LOD count and errors of the mesh from its submeshes
+void UpdateMeshLodErrors(Mesh& mesh);
+
+// GL_UNSIGNED_SHORT when every vertex can be addressed with 16 bits
+GLenum ChooseIndexType(u32 vertexCount);
+
+u32 GetIndexSize(GLenum indexType);
+
+// Appends the indices to data in the GPU index type, padded to 4 bytes
+void AppendIndices(const std::vector<u32>& indices, GLenum indexType, std::vector<u8>& data);
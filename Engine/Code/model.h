@@ -2,8 +2,17 @@
 
 #include "platform.h"
 
+// Models point at this mesh, which has no submeshes, until they are loaded
+#define EMPTY_MESH_IDX 0
+
 struct Model
 {
 	u32 meshIdx;
 	std::vector<u32> materialIdx;
+
+	// References the model holds in the asset registry, dropped by ReleaseModel
+	u64 meshKey;
+	std::vector<u32> textureIdx;
+
+	bool importing; // a worker is importing it, its completion uploads it
 };
\ No newline at end of file
@@ -12,6 +12,8 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -262,6 +264,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -392,13 +396,123 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     // NOTE: This has not been tested in unix-like systems
     struct stat attrib;
     if (stat(filepath, &attrib) == 0) {
+#ifdef __linux__
+        // Seconds aren't enough to tell apart two saves in a row
+        return (u64)attrib.st_mtim.tv_sec * 1000000000ull + (u64)attrib.st_mtim.tv_nsec;
+#else
         return attrib.st_mtime;
+#endif
     }
 #endif
 
     return 0;
 }
 
+void* GetGLProcAddress(const char* procName)
+{
+    return (void*)glfwGetProcAddress(procName);
+}
+
+MappedFile MapFile(const char* filepath)
+{
+    MappedFile file = {};
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mappingHandle)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = (const u8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (!file.data)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.size = (u64)size.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, (size_t)attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED)
+        return file;
+
+    file.data = (const u8*)data;
+    file.size = (u64)attrib.st_size;
+#endif
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (!file.data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap((void*)file.data, (size_t)file.size);
+#endif
+
+    file = MappedFile{};
+}
+
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size)
+{
+    FILE* file = fopen(filepath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", filepath);
+        return false;
+    }
+
+    const bool written = fwrite(data, 1, (size_t)size, file) == size;
+    fclose(file);
+    return written;
+}
+
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    const u8* bytes = (const u8*)data;
+    u64 hash = seed;
+    for (u64 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
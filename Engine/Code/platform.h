@@ -81,6 +81,41 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Returns the address of an OpenGL function of the current context, or NULL if the
+ * driver does not provide it. Used to load entry points that glad was not generated with.
+ */
+void* GetGLProcAddress(const char* procName);
+
+/**
+ * A read only view of a whole file mapped in memory. data is NULL if the file could
+ * not be mapped. The view stays valid until UnmapFile is called.
+ */
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;
+    void*     mappingHandle;
+};
+
+MappedFile MapFile(const char* filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * Writes a whole binary file, replacing it if it exists. Returns false on failure.
+ */
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size);
+
+#define HASH_SEED 14695981039346656037ull
+
+/**
+ * 64 bit FNV-1a hash of a block of memory. Pass a previous hash as seed to hash
+ * several blocks as if they were contiguous.
+ */
+u64 HashBytes(const void* data, u64 size, u64 seed = HASH_SEED);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
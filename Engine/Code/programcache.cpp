@@ -0,0 +1,105 @@
+#include "programcache.h"
+
+std::string GetProgramCachePath(const char* filepath, const char* programName, const char* keywords)
+{
+    std::string path = std::string(filepath) + "." + programName;
+    if (*keywords)
+    {
+        // "LIGHT_COUNT=4 GBUFFER_COMPACT" becomes ".LIGHT_COUNT-4.GBUFFER_COMPACT"
+        path += ".";
+        for (const char* c = keywords; *c; ++c)
+            path += *c == ' ' ? '.' : *c == '=' ? '-' : *c;
+    }
+    return path + ".bin";
+}
+
+u64 HashProgramSource(const std::string& source, const char* programName, const char* keywords, const char* stageDefines, const OpenGLInfo& glInfo)
+{
+    u64 hash = HashBytes(source.data(), source.size());
+    hash = HashBytes(PROGRAM_GLSL_VERSION, strlen(PROGRAM_GLSL_VERSION), hash);
+    hash = HashBytes(programName, strlen(programName) + 1, hash);
+    hash = HashBytes(keywords, strlen(keywords) + 1, hash);
+    hash = HashBytes(stageDefines, strlen(stageDefines) + 1, hash);
+    hash = HashBytes(glInfo.glVendor.c_str(), glInfo.glVendor.size() + 1, hash);
+    hash = HashBytes(glInfo.glRenderer.c_str(), glInfo.glRenderer.size() + 1, hash);
+    return HashBytes(glInfo.glVersion.c_str(), glInfo.glVersion.size() + 1, hash);
+}
+
+static bool HasProgramBinaryFormats()
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+GLuint LoadProgramBinary(const char* filepath, const char* programName, const char* keywords, u64 key)
+{
+    if (!HasProgramBinaryFormats())
+        return 0;
+
+    const std::string cachePath = GetProgramCachePath(filepath, programName, keywords);
+    MappedFile file = MapFile(cachePath.c_str());
+    if (!file.data)
+        return 0;
+
+    const ProgramCacheHeader* header = (const ProgramCacheHeader*)file.data;
+    if (file.size < sizeof(ProgramCacheHeader) || header->magic != PROGRAM_CACHE_MAGIC ||
+        header->version != PROGRAM_CACHE_VERSION || header->key != key ||
+        sizeof(ProgramCacheHeader) + (u64)header->binarySize > file.size)
+    {
+        ILOG("Program binary %s is out of date", cachePath.c_str());
+        UnmapFile(file);
+        return 0;
+    }
+
+    GLuint programHandle = glCreateProgram();
+    glProgramBinary(programHandle, header->binaryFormat, file.data + sizeof(ProgramCacheHeader), header->binarySize);
+    UnmapFile(file);
+
+    // Drivers may refuse their own binaries after an update even with the same strings
+    GLint success;
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        ILOG("Program binary %s was rejected by the driver", cachePath.c_str());
+        glDeleteProgram(programHandle);
+        return 0;
+    }
+
+    return programHandle;
+}
+
+bool SaveProgramBinary(const char* filepath, const char* programName, const char* keywords, u64 key, GLuint programHandle)
+{
+    GLint success;
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success || !HasProgramBinaryFormats())
+        return false;
+
+    GLint binarySize = 0;
+    glGetProgramiv(programHandle, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0)
+        return false;
+
+    std::vector<u8> data(sizeof(ProgramCacheHeader) + binarySize);
+    ProgramCacheHeader header = {};
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+
+    GLenum binaryFormat = 0;
+    GLsizei writtenSize = 0;
+    glGetProgramBinary(programHandle, binarySize, &writtenSize, &binaryFormat, data.data() + sizeof(ProgramCacheHeader));
+    header.binaryFormat = binaryFormat;
+    header.binarySize = (u32)writtenSize;
+    memcpy(data.data(), &header, sizeof(header));
+
+    const std::string cachePath = GetProgramCachePath(filepath, programName, keywords);
+    if (!WriteBinaryFile(cachePath.c_str(), data.data(), sizeof(ProgramCacheHeader) + writtenSize))
+    {
+        ELOG("Can't write program binary %s", cachePath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "engine.h"
+#include "shadersource.h"
+
+// Linked programs are stored next to their source as "<source>.<program>.bin", or as
+// "<source>.<program>.<keywords>.bin" for a permutation, in the driver's own binary
+// format. A binary is only used if it was made from the same source and preamble by the
+// same driver, and only if the driver still takes it, anything else falls back to
+// compiling from source.
+#define PROGRAM_CACHE_MAGIC 0x47525042u // "BPRG"
+#define PROGRAM_CACHE_VERSION 1
+
+// File layout: header, then the binary as returned by glGetProgramBinary
+struct ProgramCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u64 key;
+	u32 binaryFormat;
+	u32 binarySize;
+};
+
+// Also the key of the permutation cache, it is unique per file, program and keywords
+std::string GetProgramCachePath(const char* filepath, const char* programName, const char* keywords);
+
+/**
+ * Hash of everything the driver sees and of the driver itself: the source with its includes
+ * expanded, the preamble (version, program name, keywords and the defines of the stages,
+ * e.g. "VERTEX FRAGMENT") and the vendor, renderer and version strings.
+ */
+u64 HashProgramSource(const std::string& source, const char* programName, const char* keywords, const char* stageDefines, const OpenGLInfo& glInfo);
+
+// Returns 0 if there is no cached binary for the key or the driver rejects it
+GLuint LoadProgramBinary(const char* filepath, const char* programName, const char* keywords, u64 key);
+
+// Does nothing if the program failed to link or the driver has no binary formats
+bool SaveProgramBinary(const char* filepath, const char* programName, const char* keywords, u64 key, GLuint programHandle);
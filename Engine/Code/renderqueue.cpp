@@ -0,0 +1,66 @@
+#include "renderqueue.h"
+
+u64 MakeRenderSortKey(u32 programIdx, u32 vao, u32 textureIdx, f32 depth01)
+{
+    const u64 depthMax = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+    const u64 depth = (u64)(glm::clamp(depth01, 0.0f, 1.0f) * (f32)depthMax);
+
+    u64 key = 0;
+    key |= (u64)(programIdx & ((1u << RENDER_KEY_PROGRAM_BITS) - 1));
+    key = (key << RENDER_KEY_VAO_BITS) | (u64)(vao & ((1u << RENDER_KEY_VAO_BITS) - 1));
+    key = (key << RENDER_KEY_TEXTURE_BITS) | (u64)(textureIdx & ((1u << RENDER_KEY_TEXTURE_BITS) - 1));
+    key = (key << RENDER_KEY_DEPTH_BITS) | depth;
+    return key;
+}
+
+void SortRenderQueue(RenderQueue& queue)
+{
+    const u32 count = (u32)queue.items.size();
+    if (count < 2)
+        return;
+
+    queue.scratch.resize(count);
+
+    // All the histograms in a single read of the keys
+    u32 histograms[8][256] = {};
+    for (u32 i = 0; i < count; ++i)
+    {
+        const u64 key = queue.items[i].key;
+        for (u32 digit = 0; digit < 8; ++digit)
+            histograms[digit][(key >> (digit * 8)) & 0xff]++;
+    }
+
+    RenderItem* src = queue.items.data();
+    RenderItem* dst = queue.scratch.data();
+
+    for (u32 digit = 0; digit < 8; ++digit)
+    {
+        u32* histogram = histograms[digit];
+
+        // Every key has the same value in this digit, the pass wouldn't move anything
+        const u32 firstBucket = (src[0].key >> (digit * 8)) & 0xff;
+        if (histogram[firstBucket] == count)
+            continue;
+
+        u32 offset = 0;
+        for (u32 bucket = 0; bucket < 256; ++bucket)
+        {
+            const u32 bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            const u32 bucket = (src[i].key >> (digit * 8)) & 0xff;
+            dst[histogram[bucket]++] = src[i];
+        }
+
+        RenderItem* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != queue.items.data())
+        queue.items.swap(queue.scratch);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "platform.h"
+
+// One submesh draw of one entity. The key orders the queue so draws that share state are
+// adjacent: program, then VAO, then texture, then depth (front to back).
+struct RenderItem
+{
+	u64 key;
+	u32 entityIdx;
+	u32 submeshIdx;
+
+	// Index ranges of the visible meshlets in App::meshletRangeCounts/Offsets, no ranges
+	// draws the whole LOD
+	u32 firstRange;
+	u32 rangeCount;
+};
+
+// State changes issued and skipped while submitting the queue last frame
+struct RenderQueueStats
+{
+	u32 drawCalls;
+	u32 programBinds;
+	u32 vaoBinds;
+	u32 textureBinds;
+	u32 uniformBinds;
+	u32 skippedProgramBinds;
+	u32 skippedVaoBinds;
+	u32 skippedTextureBinds;
+	u32 skippedUniformBinds;
+};
+
+struct RenderQueue
+{
+	std::vector<RenderItem> items;
+	std::vector<RenderItem> scratch; // ping-pong storage for the radix sort
+	RenderQueueStats stats;
+};
+
+#define RENDER_KEY_PROGRAM_BITS 8
+#define RENDER_KEY_VAO_BITS     16
+#define RENDER_KEY_TEXTURE_BITS 16
+#define RENDER_KEY_DEPTH_BITS   24
+
+/**
+ * Packs the draw state into a sort key. depth01 is the view depth normalized to [0, 1].
+ * Values that don't fit in their bits are wrapped, which only costs extra state changes.
+ */
+u64 MakeRenderSortKey(u32 programIdx, u32 vao, u32 textureIdx, f32 depth01);
+
+/**
+ * Sorts the queue items by key with an LSD radix sort (8 bit digits). Digits that are the
+ * same for every item are skipped, so a queue with a single program costs fewer passes.
+ */
+void SortRenderQueue(RenderQueue& queue);
@@ -0,0 +1,132 @@
+#include "shadersource.h"
+
+static std::string GetIncludePath(const std::string& includerPath, const std::string& filename)
+{
+    const size_t separator = includerPath.find_last_of("/\\");
+    if (separator == std::string::npos)
+        return filename;
+    return includerPath.substr(0, separator + 1) + filename;
+}
+
+static u32 GetShaderFileIndex(std::vector<std::string>& files, const std::string& filepath)
+{
+    for (u32 i = 0; i < files.size(); ++i)
+        if (files[i] == filepath)
+            return i;
+    files.push_back(filepath);
+    return files.size() - 1;
+}
+
+// Returns true and the file name if the line is an #include "file" directive
+static bool ParseIncludeDirective(const char* line, const char* lineEnd, std::string& filename)
+{
+    while (line < lineEnd && (*line == ' ' || *line == '\t'))
+        line++;
+    if (line == lineEnd || *line != '#')
+        return false;
+    line++;
+    while (line < lineEnd && (*line == ' ' || *line == '\t'))
+        line++;
+    if (lineEnd - line < 7 || strncmp(line, "include", 7) != 0)
+        return false;
+    line += 7;
+
+    const char* open = (const char*)memchr(line, '"', lineEnd - line);
+    if (!open)
+        return false;
+    const char* close = (const char*)memchr(open + 1, '"', lineEnd - open - 1);
+    if (!close)
+        return false;
+
+    filename.assign(open + 1, close);
+    return true;
+}
+
+static bool AppendShaderFile(const std::string& filepath, u32 depth, std::string& source, std::vector<std::string>& files)
+{
+    if (depth > SHADER_INCLUDE_MAX_DEPTH)
+    {
+        ELOG("Shader includes nested deeper than %d levels at %s, is there an include cycle?", SHADER_INCLUDE_MAX_DEPTH, filepath.c_str());
+        return false;
+    }
+
+    String text = ReadTextFile(filepath.c_str());
+    if (!text.str)
+        return false;
+
+    const u32 fileIdx = GetShaderFileIndex(files, filepath);
+    const char* cursor = text.str;
+    const char* end = text.str + text.len;
+    u32 lineNumber = 1;
+
+    while (cursor < end)
+    {
+        const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+        if (!lineEnd)
+            lineEnd = end;
+
+        std::string filename;
+        if (ParseIncludeDirective(cursor, lineEnd, filename))
+        {
+            const std::string includePath = GetIncludePath(filepath, filename);
+            source += "#line 1 " + std::to_string(GetShaderFileIndex(files, includePath)) + "\n";
+            if (!AppendShaderFile(includePath, depth + 1, source, files))
+            {
+                ELOG("Included from %s(%u)", filepath.c_str(), lineNumber);
+                return false;
+            }
+            source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIdx) + "\n";
+        }
+        else
+        {
+            source.append(cursor, lineEnd);
+            source += '\n';
+        }
+
+        cursor = lineEnd + 1;
+        lineNumber++;
+    }
+
+    return true;
+}
+
+bool PreprocessShaderSource(const char* filepath, std::string& source, std::vector<std::string>& files)
+{
+    source.clear();
+    files.clear();
+    return AppendShaderFile(filepath, 0, source, files);
+}
+
+std::string MakeShaderPreamble(const char* programName, const char* keywords, const char* stageDefine)
+{
+    std::string preamble = PROGRAM_GLSL_VERSION;
+    preamble += "#define ";
+    preamble += programName;
+    preamble += "\n";
+
+    const char* cursor = keywords;
+    while (*cursor)
+    {
+        while (*cursor == ' ')
+            cursor++;
+        const char* keywordEnd = cursor;
+        while (*keywordEnd && *keywordEnd != ' ')
+            keywordEnd++;
+        if (keywordEnd == cursor)
+            break;
+
+        const std::string keyword(cursor, keywordEnd);
+        const size_t equals = keyword.find('=');
+        preamble += "#define ";
+        if (equals == std::string::npos)
+            preamble += keyword + " 1\n";
+        else
+            preamble += keyword.substr(0, equals) + " " + keyword.substr(equals + 1) + "\n";
+        cursor = keywordEnd;
+    }
+
+    preamble += "#define ";
+    preamble += stageDefine;
+    preamble += "\n#line 1 0\n";
+    return preamble;
+}
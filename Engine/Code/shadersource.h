@@ -0,0 +1,27 @@
+#pragma once
+
+#include "platform.h"
+
+// First line of every stage, ahead of the program, keyword and stage defines
+#define PROGRAM_GLSL_VERSION "#version 430\n"
+
+// Deeper chains of #include are taken as an include cycle
+#define SHADER_INCLUDE_MAX_DEPTH 16
+
+/**
+ * Reads a shader file and pastes the files of its #include "file" directives in place,
+ * recursively. Paths are relative to the file that includes them. Files are pasted every
+ * time they are included, since a file can be included by several program sections and
+ * only one of them is compiled, include files carry their own guards.
+ * Every pasted file is wrapped in #line directives whose source string number is its
+ * index in files, the top file being 0, so compiler messages point to the right file.
+ * Returns false if a file can't be read or the includes are nested too deep.
+ */
+bool PreprocessShaderSource(const char* filepath, std::string& source, std::vector<std::string>& files);
+
+/**
+ * Everything injected before the source of a stage: the version, the program name, the
+ * keywords and the stage. Keywords are separated by spaces, "NAME" defines NAME as 1
+ * and "NAME=VALUE" defines it as VALUE.
+ */
+std::string MakeShaderPreamble(const char* programName, const char* keywords, const char* stageDefine);
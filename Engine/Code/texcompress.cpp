@@ -0,0 +1,407 @@
+#include "texcompress.h"
+#include "glextensions.h"
+
+u32 GetSupportedTextureCodecs(const std::vector<std::string>& extensions)
+{
+    // RGTC is core since 3.0 and BPTC since 4.2, the context is always 4.3
+    u32 codecMask = (1 << TextureCodec_BC5) | (1 << TextureCodec_BC7);
+    if (HasGLExtension(extensions, "GL_EXT_texture_compression_s3tc"))
+        codecMask |= (1 << TextureCodec_BC1) | (1 << TextureCodec_BC3);
+    return codecMask;
+}
+
+static bool HasTranslucentTexels(const MipChain& mips)
+{
+    if (mips.channelCount != 2 && mips.channelCount != 4)
+        return false;
+
+    const u32 texelCount = mips.levelSizes[0].x * mips.levelSizes[0].y;
+    for (u32 i = 0; i < texelCount; ++i)
+        if (mips.pixels[i * mips.channelCount + mips.channelCount - 1] != 255)
+            return true;
+    return false;
+}
+
+TextureCodec ChooseTextureCodec(TextureKind kind, const MipChain& mips, u32 codecMask)
+{
+    TextureCodec candidates[2] = { TextureCodec_None, TextureCodec_None };
+    if (kind == TextureKind_Normal)
+    {
+        candidates[0] = TextureCodec_BC5;
+    }
+    else if (HasTranslucentTexels(mips))
+    {
+        candidates[0] = TextureCodec_BC7;
+        candidates[1] = TextureCodec_BC3;
+    }
+    else
+    {
+        candidates[0] = TextureCodec_BC1;
+        candidates[1] = TextureCodec_BC7;
+    }
+
+    for (u32 i = 0; i < ARRAY_COUNT(candidates); ++i)
+        if (candidates[i] != TextureCodec_None && (codecMask & (1 << candidates[i])))
+            return candidates[i];
+    return TextureCodec_None;
+}
+
+/**
+ * Line through the texels of a block that best fits them: their mean and the largest
+ * eigenvector of their covariance, found by power iteration. Only the first
+ * channelCount channels are considered, the others of the axis are left at 0.
+ */
+static void FitBlockLine(const u8 texels[16][4], u32 channelCount, f32 mean[4], f32 axis[4])
+{
+    for (u32 c = 0; c < 4; ++c)
+    {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 c = 0; c < channelCount; ++c)
+            mean[c] += texels[i][c];
+    for (u32 c = 0; c < channelCount; ++c)
+        mean[c] /= 16.0f;
+
+    f32 covariance[4][4] = {};
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 a = 0; a < channelCount; ++a)
+            for (u32 b = 0; b < channelCount; ++b)
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+
+    for (u32 c = 0; c < channelCount; ++c)
+        axis[c] = 1.0f;
+    for (u32 iteration = 0; iteration < 8; ++iteration)
+    {
+        f32 next[4] = {};
+        f32 length = 0.0f;
+        for (u32 a = 0; a < channelCount; ++a)
+        {
+            for (u32 b = 0; b < channelCount; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length = glm::max(length, glm::abs(next[a]));
+        }
+        // flat blocks have no direction, any axis gives the same endpoints
+        if (length < 1e-6f)
+            break;
+        for (u32 c = 0; c < channelCount; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    f32 lengthSq = 0.0f;
+    for (u32 c = 0; c < channelCount; ++c)
+        lengthSq += axis[c] * axis[c];
+    for (u32 c = 0; c < channelCount; ++c)
+        axis[c] /= glm::sqrt(lengthSq);
+}
+
+// Extremes of the texels projected on the fitted line, as two points of the line
+static void GetBlockLineEndpoints(const u8 texels[16][4], u32 channelCount, f32 endpoints[2][4])
+{
+    f32 mean[4];
+    f32 axis[4];
+    FitBlockLine(texels, channelCount, mean, axis);
+
+    f32 minT = FLT_MAX;
+    f32 maxT = -FLT_MAX;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        f32 t = 0.0f;
+        for (u32 c = 0; c < channelCount; ++c)
+            t += (texels[i][c] - mean[c]) * axis[c];
+        minT = glm::min(minT, t);
+        maxT = glm::max(maxT, t);
+    }
+
+    for (u32 c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = glm::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+        endpoints[1][c] = glm::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+    }
+}
+
+static u32 GetSquaredDistance(const u8 a[4], const u8 b[4], u32 channelCount)
+{
+    u32 distance = 0;
+    for (u32 c = 0; c < channelCount; ++c)
+        distance += (a[c] - b[c]) * (a[c] - b[c]);
+    return distance;
+}
+
+static u32 FindNearestPaletteEntry(const u8 texel[4], const u8 (*palette)[4], u32 paletteSize, u32 channelCount)
+{
+    u32 nearest = 0;
+    u32 nearestDistance = UINT32_MAX;
+    for (u32 i = 0; i < paletteSize; ++i)
+    {
+        const u32 distance = GetSquaredDistance(texel, palette[i], channelCount);
+        if (distance < nearestDistance)
+        {
+            nearest = i;
+            nearestDistance = distance;
+        }
+    }
+    return nearest;
+}
+
+static u16 PackRGB565(const f32 color[4])
+{
+    const u32 r = (u32)(color[0] * 31.0f / 255.0f + 0.5f);
+    const u32 g = (u32)(color[1] * 63.0f / 255.0f + 0.5f);
+    const u32 b = (u32)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(u16 packed, u8 color[4])
+{
+    const u32 r = (packed >> 11) & 31;
+    const u32 g = (packed >> 5) & 63;
+    const u32 b = packed & 31;
+    color[0] = (u8)((r << 3) | (r >> 2));
+    color[1] = (u8)((g << 2) | (g >> 4));
+    color[2] = (u8)((b << 3) | (b >> 2));
+    color[3] = 255;
+}
+
+void EncodeBC1Block(const u8 texels[16][4], u8* block)
+{
+    f32 endpoints[2][4];
+    GetBlockLineEndpoints(texels, 3, endpoints);
+
+    // Pull the endpoints in by 1/16 of the range, the extremes are usually outliers and
+    // the interpolated colors end up closer to the rest of the block
+    for (u32 c = 0; c < 3; ++c)
+    {
+        const f32 inset = (endpoints[0][c] - endpoints[1][c]) / 16.0f;
+        endpoints[0][c] -= inset;
+        endpoints[1][c] += inset;
+    }
+
+    u16 color0 = PackRGB565(endpoints[0]);
+    u16 color1 = PackRGB565(endpoints[1]);
+    // color0 > color1 selects the four color mode, without the transparent black entry
+    if (color0 < color1)
+    {
+        const u16 tmp = color0;
+        color0 = color1;
+        color1 = tmp;
+    }
+
+    u32 indices = 0;
+    if (color0 != color1)
+    {
+        u8 palette[4][4];
+        UnpackRGB565(color0, palette[0]);
+        UnpackRGB565(color1, palette[1]);
+        for (u32 c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (u8)((2 * palette[0][c] + palette[1][c] + 1) / 3);
+            palette[3][c] = (u8)((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+        }
+
+        for (u32 i = 0; i < 16; ++i)
+            indices |= FindNearestPaletteEntry(texels[i], palette, 4, 3) << (2 * i);
+    }
+
+    memcpy(block, &color0, 2);
+    memcpy(block + 2, &color1, 2);
+    memcpy(block + 4, &indices, 4);
+}
+
+// BC4 block of one channel: two 8 bit endpoints and 3 bit indices in the eight value mode
+static void EncodeBC4Block(const u8 texels[16][4], u32 channel, u8* block)
+{
+    u8 lo = 255;
+    u8 hi = 0;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        lo = glm::min(lo, texels[i][channel]);
+        hi = glm::max(hi, texels[i][channel]);
+    }
+
+    // hi > lo selects the eight value mode, index 0 is hi, 1 is lo and 2 to 7 go from
+    // hi to lo in sevenths
+    u64 indices = 0;
+    if (hi > lo)
+    {
+        const u32 range = hi - lo;
+        for (u32 i = 0; i < 16; ++i)
+        {
+            const u32 step = ((texels[i][channel] - lo) * 7 + range / 2) / range;
+            const u64 index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+            indices |= index << (3 * i);
+        }
+    }
+
+    block[0] = hi;
+    block[1] = lo;
+    for (u32 i = 0; i < 6; ++i)
+        block[2 + i] = (u8)(indices >> (8 * i));
+}
+
+void EncodeBC3Block(const u8 texels[16][4], u8* block)
+{
+    EncodeBC4Block(texels, 3, block);
+    EncodeBC1Block(texels, block + 8);
+}
+
+void EncodeBC5Block(const u8 texels[16][4], u8* block)
+{
+    EncodeBC4Block(texels, 0, block);
+    EncodeBC4Block(texels, 1, block + 8);
+}
+
+static void WriteBlockBits(u8* block, u32& bit, u32 value, u32 count)
+{
+    for (u32 i = 0; i < count; ++i, ++bit)
+        if ((value >> i) & 1)
+            block[bit / 8] |= (u8)(1 << (bit % 8));
+}
+
+/**
+ * Mode 6 only: one subset, RGBA endpoints of 7 bits plus a p-bit each and 4 bit indices.
+ * It is the mode that suits smooth blocks best, the other modes would mostly help blocks
+ * with several distinct colors.
+ */
+void EncodeBC7Block(const u8 texels[16][4], u8* block)
+{
+    static const u32 weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    f32 endpoints[2][4];
+    GetBlockLineEndpoints(texels, 4, endpoints);
+
+    // Each endpoint is 7 bits per channel plus a low bit shared by its channels, pick
+    // the low bit that rounds the endpoint best
+    u8 quantized[2][4];
+    u32 pbits[2];
+    u8 colors[2][4];
+    for (u32 e = 0; e < 2; ++e)
+    {
+        f32 bestError = FLT_MAX;
+        for (u32 p = 0; p < 2; ++p)
+        {
+            u8 candidate[4];
+            f32 error = 0.0f;
+            for (u32 c = 0; c < 4; ++c)
+            {
+                candidate[c] = (u8)glm::clamp((i32)((endpoints[e][c] - p) / 2.0f + 0.5f), 0, 127);
+                const f32 delta = (f32)((candidate[c] << 1) | p) - endpoints[e][c];
+                error += delta * delta;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                memcpy(quantized[e], candidate, 4);
+            }
+        }
+        for (u32 c = 0; c < 4; ++c)
+            colors[e][c] = (u8)((quantized[e][c] << 1) | pbits[e]);
+    }
+
+    u8 palette[16][4];
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 c = 0; c < 4; ++c)
+            palette[i][c] = (u8)(((64 - weights[i]) * colors[0][c] + weights[i] * colors[1][c] + 32) >> 6);
+
+    u32 indices[16];
+    for (u32 i = 0; i < 16; ++i)
+        indices[i] = FindNearestPaletteEntry(texels[i], palette, 16, 4);
+
+    // The top bit of the first index is implicitly 0, swap the endpoints if it isn't
+    if (indices[0] & 8)
+    {
+        for (u32 c = 0; c < 4; ++c)
+        {
+            const u8 tmp = quantized[0][c];
+            quantized[0][c] = quantized[1][c];
+            quantized[1][c] = tmp;
+        }
+        const u32 tmp = pbits[0];
+        pbits[0] = pbits[1];
+        pbits[1] = tmp;
+        for (u32 i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(block, 0, 16);
+    u32 bit = 0;
+    WriteBlockBits(block, bit, 1 << 6, 7);
+    for (u32 c = 0; c < 4; ++c)
+    {
+        WriteBlockBits(block, bit, quantized[0][c], 7);
+        WriteBlockBits(block, bit, quantized[1][c], 7);
+    }
+    WriteBlockBits(block, bit, pbits[0], 1);
+    WriteBlockBits(block, bit, pbits[1], 1);
+    WriteBlockBits(block, bit, indices[0], 3);
+    for (u32 i = 1; i < 16; ++i)
+        WriteBlockBits(block, bit, indices[i], 4);
+}
+
+static void ReadBlockTexels(const u8* pixels, glm::ivec2 size, u32 channelCount, u32 blockX, u32 blockY, u8 texels[16][4])
+{
+    for (u32 y = 0; y < TEXTURE_BLOCK_SIZE; ++y)
+    {
+        const u32 py = glm::min(blockY * TEXTURE_BLOCK_SIZE + y, (u32)size.y - 1);
+        for (u32 x = 0; x < TEXTURE_BLOCK_SIZE; ++x)
+        {
+            const u32 px = glm::min(blockX * TEXTURE_BLOCK_SIZE + x, (u32)size.x - 1);
+            const u8* src = pixels + (py * size.x + px) * channelCount;
+            u8* texel = texels[y * TEXTURE_BLOCK_SIZE + x];
+            switch (channelCount)
+            {
+                case 1: texel[0] = texel[1] = texel[2] = src[0]; texel[3] = 255; break;
+                case 2: texel[0] = texel[1] = texel[2] = src[0]; texel[3] = src[1]; break;
+                case 3: texel[0] = src[0]; texel[1] = src[1]; texel[2] = src[2]; texel[3] = 255; break;
+                default: memcpy(texel, src, 4); break;
+            }
+        }
+    }
+}
+
+void CompressMipChain(const MipChain& mips, TextureCodec codec, MipChain& compressed)
+{
+    ASSERT(mips.codec == TextureCodec_None && codec != TextureCodec_None, "Only uncompressed chains can be compressed");
+
+    compressed.codec = codec;
+    compressed.channelCount = mips.channelCount;
+    compressed.levelCount = mips.levelCount;
+
+    u32 bytes = 0;
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        compressed.levelSizes[level] = mips.levelSizes[level];
+        compressed.levelOffsets[level] = bytes;
+        bytes += GetMipRowSize(compressed, level) * GetMipRowCount(compressed, level);
+    }
+    compressed.pixels.resize(bytes);
+
+    const u32 blockSize = GetTextureCodecBlockSize(codec);
+    for (u32 level = 0; level < mips.levelCount; ++level)
+    {
+        const glm::ivec2 size = mips.levelSizes[level];
+        const u8* pixels = mips.pixels.data() + mips.levelOffsets[level];
+        u8* block = compressed.pixels.data() + compressed.levelOffsets[level];
+
+        const u32 blocksX = GetMipRowSize(compressed, level) / blockSize;
+        const u32 blocksY = GetMipRowCount(compressed, level);
+        for (u32 by = 0; by < blocksY; ++by)
+        {
+            for (u32 bx = 0; bx < blocksX; ++bx, block += blockSize)
+            {
+                u8 texels[16][4];
+                ReadBlockTexels(pixels, size, mips.channelCount, bx, by, texels);
+                switch (codec)
+                {
+                    case TextureCodec_BC1: EncodeBC1Block(texels, block); break;
+                    case TextureCodec_BC3: EncodeBC3Block(texels, block); break;
+                    case TextureCodec_BC5: EncodeBC5Block(texels, block); break;
+                    case TextureCodec_BC7: EncodeBC7Block(texels, block); break;
+                    default: break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "texture.h"
+
+// Bit per TextureCodec the driver can sample from
+u32 GetSupportedTextureCodecs(const std::vector<std::string>& extensions);
+
+/**
+ * Normal maps go to BC5. Color goes to BC1 if it is opaque and to BC7 if it has alpha,
+ * BC3 and BC7 stand in for each other when one of them isn't supported. Returns
+ * TextureCodec_None if no suitable codec is in codecMask.
+ */
+TextureCodec ChooseTextureCodec(TextureKind kind, const MipChain& mips, u32 codecMask);
+
+// Encodes one 4x4 block of RGBA texels, texel 0 is the top left one
+void EncodeBC1Block(const u8 texels[16][4], u8* block);
+void EncodeBC3Block(const u8 texels[16][4], u8* block);
+void EncodeBC5Block(const u8 texels[16][4], u8* block);
+void EncodeBC7Block(const u8 texels[16][4], u8* block);
+
+/**
+ * Compresses every level of an uncompressed chain. Edge blocks of levels that aren't a
+ * multiple of 4 repeat their last row or column. Texels with fewer than 4 channels are
+ * expanded as luminance, luminance alpha or RGB with an opaque alpha.
+ */
+void CompressMipChain(const MipChain& mips, TextureCodec codec, MipChain& compressed);
@@ -0,0 +1,105 @@
+#include "texture.h"
+#include "glextensions.h"
+
+void BuildMipChain(const u8* pixels, glm::ivec2 size, u32 channelCount, MipChain& mips)
+{
+    mips.codec = TextureCodec_None;
+    mips.channelCount = channelCount;
+    mips.levelCount = 0;
+
+    u32 bytes = 0;
+    glm::ivec2 levelSize = size;
+    while (mips.levelCount < TEXTURE_MAX_LEVELS)
+    {
+        mips.levelOffsets[mips.levelCount] = bytes;
+        mips.levelSizes[mips.levelCount] = levelSize;
+        mips.levelCount++;
+        bytes += levelSize.x * levelSize.y * channelCount;
+
+        if (levelSize.x == 1 && levelSize.y == 1)
+            break;
+        levelSize = glm::max(levelSize / 2, glm::ivec2(1));
+    }
+
+    mips.pixels.resize(bytes);
+    memcpy(mips.pixels.data(), pixels, size.x * size.y * channelCount);
+
+    for (u32 level = 1; level < mips.levelCount; ++level)
+    {
+        const glm::ivec2 srcSize = mips.levelSizes[level - 1];
+        const glm::ivec2 dstSize = mips.levelSizes[level];
+        const u8* src = mips.pixels.data() + mips.levelOffsets[level - 1];
+        u8* dst = mips.pixels.data() + mips.levelOffsets[level];
+
+        for (i32 y = 0; y < dstSize.y; ++y)
+        {
+            const i32 y0 = glm::min(y * 2, srcSize.y - 1);
+            const i32 y1 = glm::min(y * 2 + 1, srcSize.y - 1);
+            for (i32 x = 0; x < dstSize.x; ++x)
+            {
+                const i32 x0 = glm::min(x * 2, srcSize.x - 1);
+                const i32 x1 = glm::min(x * 2 + 1, srcSize.x - 1);
+                for (u32 c = 0; c < channelCount; ++c)
+                {
+                    const u32 sum = src[(y0 * srcSize.x + x0) * channelCount + c] + src[(y0 * srcSize.x + x1) * channelCount + c] +
+                                    src[(y1 * srcSize.x + x0) * channelCount + c] + src[(y1 * srcSize.x + x1) * channelCount + c];
+                    dst[(y * dstSize.x + x) * channelCount + c] = (u8)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+u32 GetMipRowSize(const MipChain& mips, u32 level)
+{
+    const glm::ivec2 size = mips.levelSizes[level];
+    if (mips.codec == TextureCodec_None)
+        return size.x * mips.channelCount;
+    return (size.x + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE * GetTextureCodecBlockSize(mips.codec);
+}
+
+u32 GetMipRowCount(const MipChain& mips, u32 level)
+{
+    const glm::ivec2 size = mips.levelSizes[level];
+    if (mips.codec == TextureCodec_None)
+        return size.y;
+    return (size.y + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+u32 GetMipTexelRows(const MipChain& mips, u32 level, u32 row, u32 rowCount)
+{
+    const u32 height = mips.levelSizes[level].y;
+    if (mips.codec == TextureCodec_None)
+        return glm::min(rowCount, height - row);
+    return glm::min(rowCount * TEXTURE_BLOCK_SIZE, height - row * TEXTURE_BLOCK_SIZE);
+}
+
+u32 GetTextureCodecBlockSize(TextureCodec codec)
+{
+    switch (codec)
+    {
+        case TextureCodec_BC1: return 8;
+        case TextureCodec_BC3:
+        case TextureCodec_BC5:
+        case TextureCodec_BC7: return 16;
+        default: return 0;
+    }
+}
+
+const char* GetTextureCodecName(TextureCodec codec)
+{
+    static const char* names[TextureCodec_Count] = { "RGB(A)8", "BC1", "BC3", "BC5", "BC7" };
+    return names[codec];
+}
+
+GLenum GetTextureCodecFormat(TextureCodec codec)
+{
+    switch (codec)
+    {
+        case TextureCodec_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureCodec_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureCodec_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TextureCodec_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default: return 0;
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "platform.h"
+
+// Enough levels for a 32K texture
+#define TEXTURE_MAX_LEVELS 16
+
+// Texture bytes copied to the GPU per frame, the rest waits for the next frames. It is
+// also the size of each region of the upload ring, so it bounds the rows of one copy.
+#define TEXTURE_STREAM_BUDGET MB(4)
+
+// What the texels mean, it decides the compressed format
+enum TextureKind
+{
+	TextureKind_Color,
+	TextureKind_Normal, // tangent space XY as two-channel BC5, kept for when normal mapping is added
+};
+
+// Block compressed formats, all of them made of 4x4 texel blocks
+enum TextureCodec
+{
+	TextureCodec_None,
+	TextureCodec_BC1, // opaque RGB, 8 bytes per block
+	TextureCodec_BC3, // RGBA, 16 bytes per block
+	TextureCodec_BC5, // two channels, 16 bytes per block
+	TextureCodec_BC7, // RGBA, 16 bytes per block
+	TextureCodec_Count
+};
+
+#define TEXTURE_BLOCK_SIZE 4
+
+// Every level of an image, level 0 first, with unpadded rows so they can be uploaded
+// with an unpack alignment of 1. Compressed levels store rows of blocks instead of rows
+// of texels.
+struct MipChain
+{
+	std::vector<u8> pixels;
+	TextureCodec codec;
+	u32 channelCount; // of the uncompressed texels
+	u32 levelCount;
+	u32 levelOffsets[TEXTURE_MAX_LEVELS];
+	glm::ivec2 levelSizes[TEXTURE_MAX_LEVELS];
+};
+
+// Layers of the first array of a bucket, each new array of the bucket has as many layers
+// as the ones before it together, up to the max. Most sizes only have a texture or two,
+// so buckets start with a single layer.
+#define TEXTURE_ARRAY_MIN_LAYERS 1
+#define TEXTURE_ARRAY_MAX_LAYERS 64
+
+// Textures of the same size, format and level count live in the layers of 2D arrays, so
+// a multi-draw only needs a bind per array. Each texture also gets a 2D view of its layer
+// for the code that binds textures one by one. Arrays never grow or go away, the layers
+// of released textures are reused.
+struct TextureArray
+{
+	GLuint handle;
+	GLuint64 bindlessHandle; // 0 without ARB_bindless_texture
+	glm::ivec2 size;
+	GLenum internalFormat;
+	u32 levelCount;
+	u32 layerCount;
+	u32 layerSize; // bytes of every level of a layer
+	std::vector<u32> freeLayers;
+};
+
+// Entry of the texture table read by the shaders (std430), indexed like App::textures
+struct GpuTexture
+{
+	u32 layer;
+	f32 minLevel; // the larger levels aren't streamed in yet
+	GLuint64 arrayHandle; // bindless handle of the array, 0 if the renderer binds it
+};
+
+// A texture being streamed from its smallest level to its largest one. Its view
+// replaces the placeholder of the texture as soon as the smallest level is in.
+struct TextureStreamRequest
+{
+	u32 texIdx;
+	u32 arrayIdx;
+	u32 layer;
+	GLuint view;
+	GLenum dataFormat; // the internal format if compressed
+	MipChain* mips;
+	i32 level; // next level to copy, -1 once they are all in
+	u32 row;   // next row of that level
+	bool resident;
+	bool reload; // the texture keeps its previous version until every level is in
+};
+
+// A band of rows copied to the upload ring this frame, submitted once the ring is unmapped
+struct TextureStreamUpload
+{
+	GLuint arrayHandle;
+	GLuint view;
+	u32 layer;
+	GLenum dataFormat;
+	i32 level;
+	u32 row; // in texels even if compressed
+	u32 rowCount;
+	u32 width;
+	u32 offset; // in the upload ring
+	u32 size;
+	bool compressed;
+	bool completesLevel;
+};
+
+/**
+ * Builds the mip chain of an 8 bit image with a 2x2 box filter. Odd sizes repeat their
+ * last row or column.
+ */
+void BuildMipChain(const u8* pixels, glm::ivec2 size, u32 channelCount, MipChain& mips);
+
+// Bytes and number of the rows of a level, rows of blocks if compressed
+u32 GetMipRowSize(const MipChain& mips, u32 level);
+u32 GetMipRowCount(const MipChain& mips, u32 level);
+
+// Texel rows covered by rowCount rows of a level starting at row, clamped to the level
+u32 GetMipTexelRows(const MipChain& mips, u32 level, u32 row, u32 rowCount);
+
+u32 GetTextureCodecBlockSize(TextureCodec codec);
+
+const char* GetTextureCodecName(TextureCodec codec);
+
+// Internal format of a compressed texture, 0 for TextureCodec_None
+GLenum GetTextureCodecFormat(TextureCodec codec);
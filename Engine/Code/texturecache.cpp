@@ -0,0 +1,106 @@
+#include "texturecache.h"
+
+std::string GetTextureCachePath(const char* filename)
+{
+    return std::string(filename) + ".ctex";
+}
+
+u64 HashTextureSource(const MappedFile& source, TextureKind kind, u32 codecMask)
+{
+    u64 hash = HashBytes(source.data, source.size);
+    hash = HashBytes(&kind, sizeof(kind), hash);
+    return HashBytes(&codecMask, sizeof(codecMask), hash);
+}
+
+static bool ValidateTextureCache(const MappedFile& file, u64 sourceHash)
+{
+    if (file.size < sizeof(TextureCacheHeader))
+        return false;
+
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file.data;
+    if (header->magic != TEXTURE_CACHE_MAGIC || header->version != TEXTURE_CACHE_VERSION ||
+        header->sourceHash != sourceHash)
+        return false;
+
+    if (header->codec >= TextureCodec_Count || header->levelCount == 0 || header->levelCount > TEXTURE_MAX_LEVELS ||
+        sizeof(TextureCacheHeader) + (u64)header->dataSize > file.size)
+        return false;
+
+    // every level must fit in the data, at the size its codec gives it
+    MipChain mips = {};
+    mips.codec = (TextureCodec)header->codec;
+    mips.channelCount = header->channelCount;
+    for (u32 i = 0; i < header->levelCount; ++i)
+    {
+        mips.levelSizes[i] = header->levelSizes[i];
+        if (mips.levelSizes[i].x <= 0 || mips.levelSizes[i].y <= 0)
+            return false;
+        if ((u64)header->levelOffsets[i] + (u64)GetMipRowSize(mips, i) * GetMipRowCount(mips, i) > header->dataSize)
+            return false;
+    }
+
+    return true;
+}
+
+bool ReadTextureCache(const char* filename, u64 sourceHash, MipChain& mips)
+{
+    const std::string cachePath = GetTextureCachePath(filename);
+
+    MappedFile file = MapFile(cachePath.c_str());
+    if (!file.data)
+        return false;
+
+    if (!ValidateTextureCache(file, sourceHash))
+    {
+        ILOG("Cooked texture %s is out of date", cachePath.c_str());
+        UnmapFile(file);
+        return false;
+    }
+
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file.data;
+    mips.codec = (TextureCodec)header->codec;
+    mips.channelCount = header->channelCount;
+    mips.levelCount = header->levelCount;
+    for (u32 i = 0; i < header->levelCount; ++i)
+    {
+        mips.levelOffsets[i] = header->levelOffsets[i];
+        mips.levelSizes[i] = header->levelSizes[i];
+    }
+
+    const u8* data = file.data + sizeof(TextureCacheHeader);
+    mips.pixels.assign(data, data + header->dataSize);
+    UnmapFile(file);
+
+    return true;
+}
+
+bool WriteTextureCache(const char* filename, u64 sourceHash, const MipChain& mips)
+{
+    TextureCacheHeader header = {};
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.codec = mips.codec;
+    header.channelCount = mips.channelCount;
+    header.levelCount = mips.levelCount;
+    header.dataSize = (u32)mips.pixels.size();
+    for (u32 i = 0; i < mips.levelCount; ++i)
+    {
+        header.levelOffsets[i] = mips.levelOffsets[i];
+        header.levelSizes[i] = mips.levelSizes[i];
+    }
+
+    std::vector<u8> data(sizeof(header) + mips.pixels.size());
+    memcpy(data.data(), &header, sizeof(header));
+    if (!mips.pixels.empty())
+        memcpy(data.data() + sizeof(header), mips.pixels.data(), mips.pixels.size());
+
+    const std::string cachePath = GetTextureCachePath(filename);
+    if (!WriteBinaryFile(cachePath.c_str(), data.data(), data.size()))
+    {
+        ELOG("Can't write cooked texture %s", cachePath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "texture.h"
+
+// Cooked textures are stored next to their source as "<source>.ctex", with every level
+// already built and compressed, so a cache hit skips decoding, filtering and encoding.
+// Like cooked meshes they are only used if made from the same source contents with the
+// same settings.
+#define TEXTURE_CACHE_MAGIC 0x58455443u // "CTEX"
+#define TEXTURE_CACHE_VERSION 1
+
+// File layout: header, then the levels as laid out in MipChain::pixels
+struct TextureCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u64 sourceHash;
+	u32 codec;
+	u32 channelCount;
+	u32 levelCount;
+	u32 dataSize;
+	u32 levelOffsets[TEXTURE_MAX_LEVELS];
+	glm::ivec2 levelSizes[TEXTURE_MAX_LEVELS];
+};
+
+std::string GetTextureCachePath(const char* filename);
+
+// Hash of the source file contents combined with the kind and the codecs it could use
+u64 HashTextureSource(const MappedFile& source, TextureKind kind, u32 codecMask);
+
+// Fills the chain from the cooked file. Returns false if there is no valid one. Thread safe.
+bool ReadTextureCache(const char* filename, u64 sourceHash, MipChain& mips);
+
+// Thread safe
+bool WriteTextureCache(const char* filename, u64 sourceHash, const MipChain& mips);
@@ -0,0 +1,103 @@
+#include "vertex.h"
+
+#include <glm/gtc/packing.hpp>
+
+GLenum GetVertexAttributeGLType(u8 type)
+{
+    switch (type)
+    {
+        case VertexAttributeType_Half: return GL_HALF_FLOAT;
+        case VertexAttributeType_Unorm16: return GL_UNSIGNED_SHORT;
+        case VertexAttributeType_Snorm2_10_10_10: return GL_INT_2_10_10_10_REV;
+        default: return GL_FLOAT;
+    }
+}
+
+GLboolean IsVertexAttributeNormalized(u8 type)
+{
+    return type == VertexAttributeType_Unorm16 || type == VertexAttributeType_Snorm2_10_10_10 ? GL_TRUE : GL_FALSE;
+}
+
+u32 GetVertexAttributeSize(const VertexBufferAttribute& attribute)
+{
+    switch (attribute.type)
+    {
+        case VertexAttributeType_Half:
+        case VertexAttributeType_Unorm16: return attribute.componentCount * 2;
+        case VertexAttributeType_Snorm2_10_10_10: return 4;
+        default: return attribute.componentCount * 4;
+    }
+}
+
+static void WriteVertexData(std::vector<u8>& data, u32 offset, const void* value, u32 size)
+{
+    memcpy(&data[offset], value, size);
+}
+
+void QuantizeVertices(const std::vector<f32>& vertices, const VertexBufferLayout& layout,
+                      const glm::vec3& positionOffset, f32 positionScale,
+                      std::vector<u8>& quantizedVertices, VertexBufferLayout& quantizedLayout)
+{
+    // Float offsets of the source attributes by location, UINT32_MAX if missing
+    u32 srcOffsets[5] = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX };
+    for (u32 i = 0; i < layout.attributes.size(); ++i)
+        if (layout.attributes[i].location < ARRAY_COUNT(srcOffsets))
+            srcOffsets[layout.attributes[i].location] = layout.attributes[i].offset / sizeof(f32);
+
+    ASSERT(srcOffsets[0] != UINT32_MAX && srcOffsets[1] != UINT32_MAX, "Vertices need a position and a normal");
+
+    // The 4th position component pads the attribute to 8 bytes, 4 byte alignment keeps
+    // every attribute on the fast fetch path
+    quantizedLayout = VertexBufferLayout{};
+    quantizedLayout.attributes.push_back(VertexBufferAttribute{ 0, 4, 0, VertexAttributeType_Unorm16 });
+    quantizedLayout.attributes.push_back(VertexBufferAttribute{ 1, 4, 8, VertexAttributeType_Snorm2_10_10_10 });
+    quantizedLayout.stride = 12;
+    const u32 dstTexCoord = quantizedLayout.stride;
+    if (srcOffsets[2] != UINT32_MAX)
+    {
+        quantizedLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, quantizedLayout.stride, VertexAttributeType_Half });
+        quantizedLayout.stride += 4;
+    }
+    const u32 dstTangent = quantizedLayout.stride;
+    const bool hasTangentSpace = srcOffsets[3] != UINT32_MAX && srcOffsets[4] != UINT32_MAX;
+    if (hasTangentSpace)
+    {
+        quantizedLayout.attributes.push_back(VertexBufferAttribute{ 3, 4, quantizedLayout.stride, VertexAttributeType_Snorm2_10_10_10 });
+        quantizedLayout.stride += 4;
+    }
+
+    const u32 floatStride = layout.stride / sizeof(f32);
+    const u32 vertexCount = (u32)vertices.size() / floatStride;
+    const f32 inverseScale = positionScale > 0.0f ? 1.0f / positionScale : 0.0f;
+
+    const u32 base = (u32)quantizedVertices.size();
+    quantizedVertices.resize(base + vertexCount * quantizedLayout.stride);
+    for (u32 v = 0; v < vertexCount; ++v)
+    {
+        const f32* src = &vertices[v * floatStride];
+        const u32 dst = base + v * quantizedLayout.stride;
+
+        const glm::vec3 position(src[srcOffsets[0]], src[srcOffsets[0] + 1], src[srcOffsets[0] + 2]);
+        const glm::u64 packedPosition = glm::packUnorm4x16(glm::vec4((position - positionOffset) * inverseScale, 0.0f));
+        WriteVertexData(quantizedVertices, dst, &packedPosition, 8);
+
+        const glm::vec3 normal(src[srcOffsets[1]], src[srcOffsets[1] + 1], src[srcOffsets[1] + 2]);
+        const glm::u32 packedNormal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+        WriteVertexData(quantizedVertices, dst + 8, &packedNormal, 4);
+
+        if (srcOffsets[2] != UINT32_MAX)
+        {
+            const glm::u32 packedTexCoord = glm::packHalf2x16(glm::vec2(src[srcOffsets[2]], src[srcOffsets[2] + 1]));
+            WriteVertexData(quantizedVertices, dst + dstTexCoord, &packedTexCoord, 4);
+        }
+
+        if (hasTangentSpace)
+        {
+            const glm::vec3 tangent(src[srcOffsets[3]], src[srcOffsets[3] + 1], src[srcOffsets[3] + 2]);
+            const glm::vec3 bitangent(src[srcOffsets[4]], src[srcOffsets[4] + 1], src[srcOffsets[4] + 2]);
+            const f32 bitangentSign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            const glm::u32 packedTangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, bitangentSign));
+            WriteVertexData(quantizedVertices, dst + dstTangent, &packedTangent, 4);
+        }
+    }
+}
@@ -1,12 +1,26 @@
 #pragma once
 
+#include <glad/glad.h>
+
 #include "platform.h"
 
+// Storage type of a vertex attribute. Imported meshes are quantized (see QuantizeVertices),
+// floats are kept for the embedded geometry
+enum VertexAttributeType
+{
+	VertexAttributeType_Float,
+	VertexAttributeType_Half,
+	VertexAttributeType_Unorm16,        // normalized to [0, 1]
+	VertexAttributeType_Snorm2_10_10_10, // normalized to [-1, 1], always 4 components
+	VertexAttributeType_Count
+};
+
 struct VertexBufferAttribute
 {
 	u8 location;
 	u8 componentCount;
 	u8 offset;
+	u8 type; // VertexAttributeType
 };
 
 struct VertexBufferLayout
@@ -30,4 +44,21 @@ struct Vao
 {
 	GLuint handle;
 	GLuint programHandle;
-};
\ No newline at end of file
+};
+
+GLenum GetVertexAttributeGLType(u8 type);
+
+GLboolean IsVertexAttributeNormalized(u8 type);
+
+u32 GetVertexAttributeSize(const VertexBufferAttribute& attribute);
+
+/**
+ * Appends to quantizedVertices the float vertices (position, normal, uv, tangent,
+ * bitangent at locations 0-4) compressed to unorm16 positions relative to the mesh
+ * bounds, 2_10_10_10 normals and tangents with the bitangent sign in w, and half uvs.
+ * The bitangent attribute is dropped. Positions map back with offset + q * scale, a
+ * single scale so the dequantization can go in the world matrix without skewing normals.
+ */
+void QuantizeVertices(const std::vector<f32>& vertices, const VertexBufferLayout& layout,
+                      const glm::vec3& positionOffset, f32 positionScale,
+                      std::vector<u8>& quantizedVertices, VertexBufferLayout& quantizedLayout);
@@ -0,0 +1,29 @@
+///////////////////////////////////////////////////////////////////////
+// Light list of the clustered programs, directional lights go first.
+// The grid constants must match Light.h
+///////////////////////////////////////////////////////////////////////
+#ifndef CLUSTER_LIGHTS_GLSL
+#define CLUSTER_LIGHTS_GLSL
+
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+
+struct Light
+{
+	vec3 color;
+	uint type;
+	vec3 direction;
+	float radius;
+	vec3 position;
+	float padding;
+};
+
+layout(binding = 3, std430) readonly buffer Lights
+{
+	uint uLightCount;
+	uint uDirectionalLightCount; // directional lights go first
+	Light uLights[];
+};
+
+#endif
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////
+// G-buffer encoding. The GBUFFER_COMPACT permutations store octahedral
+// normals and have no position attachment, it is rebuilt from depth
+///////////////////////////////////////////////////////////////////////
+#ifndef GBUFFER_GLSL
+#define GBUFFER_GLSL
+
+vec2 EncodeOctahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+	return e * 0.5 + 0.5;
+}
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+#ifdef GBUFFER_COMPACT
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection;
+
+vec3 ReconstructPosition(vec2 texCoord)
+{
+	float depth = texture(uDepth, texCoord).r;
+	vec4 position = uInverseViewProjection * vec4(vec3(texCoord, depth) * 2.0 - 1.0, 1.0);
+	return position.xyz / position.w;
+}
+#endif
+
+// World space position and normal of a pixel, for the lighting programs
+vec3 ReadGBufferPosition(sampler2D positions, vec2 texCoord)
+{
+#ifdef GBUFFER_COMPACT
+	return ReconstructPosition(texCoord);
+#else
+	return texture(positions, texCoord).rgb;
+#endif
+}
+
+vec3 ReadGBufferNormal(sampler2D normals, vec2 texCoord)
+{
+#ifdef GBUFFER_COMPACT
+	return DecodeOctahedral(texture(normals, texCoord).rg);
+#else
+	return texture(normals, texCoord).rgb;
+#endif
+}
+
+#endif
@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////
+// Global params shared by the forward and the full screen deferred
+// programs, must match the layout pushed by Render() in engine.cpp
+///////////////////////////////////////////////////////////////////////
+#ifndef LIGHTS_GLSL
+#define LIGHTS_GLSL
+
+struct Light
+{
+	unsigned int type;
+	vec3 color;
+	vec3 direction;
+	vec3 position;
+};
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+	vec3 uCameraPosition;
+	unsigned int uLightCount;
+	Light uLight[16];
+};
+
+// LIGHT_COUNT permutations have the count baked in so the light loops get unrolled
+#ifdef LIGHT_COUNT
+#define GLOBAL_LIGHT_COUNT LIGHT_COUNT
+#else
+#define GLOBAL_LIGHT_COUNT int(uLightCount)
+#endif
+
+// Diffuse light of every global light at a world space position
+vec3 ComputeLighting(vec3 position, vec3 norm)
+{
+	vec3 result = vec3(0.0);
+
+	for(int i = 0; i < GLOBAL_LIGHT_COUNT; i++)
+	{
+		if(uLight[i].type == 0)
+		{
+			float diff = max(dot(norm, uLight[i].direction), 0.0);
+			vec3 diffuse = diff * uLight[i].color;
+			result += diffuse;
+		}
+		if(uLight[i].type == 1)
+		{
+			vec3 lightDir = normalize(uLight[i].position - position);
+			float diff = max(dot(norm, lightDir), 0.0);
+			vec3 diffuse = diff * uLight[i].color;
+			float distance = length(uLight[i].position - position);
+			float attenuation = 1.0 / (distance * distance);
+			attenuation *= 2;
+			diffuse *= attenuation;
+			result += diffuse;
+		}
+	}
+
+	return result;
+}
+
+#endif
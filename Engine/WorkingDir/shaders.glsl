@@ -15,20 +15,7 @@ layout(location = 2) in vec2 aTexCoord;
 //uniform mat4 proj;
 //uniform mat4 view;
 
-struct Light
-{
-	unsigned int type;
-	vec3 color;
-	vec3 direction;
-	vec3 position;
-};
-
-layout(binding = 0, std140) uniform GlobalParams
-{
-	vec3 uCameraPosition;
-	unsigned int uLightCount;
-	Light uLight[16];
-};
+#include "lights.glsl"
 
 layout(binding = 1, std140) uniform LocalParams
 {
@@ -61,22 +48,96 @@ void main()
 
 #elif defined(FRAGMENT) /////////////////////////////////////////////// 
 
-struct Light
+#include "lights.glsl"
+
+// TODO: Write your fragment shader here
+in vec2 vTexCoord;
+in vec3 vPosition;
+in vec3 vNormal;
+in vec3 vViewDir;
+
+uniform sampler2D uTexture;
+
+layout(location = 0) out vec4 oColor;
+layout(location = 1) out vec4 posColor;
+layout(location = 2) out vec4 norColor;
+
+// Forward: lit color, position and normal
+// DEFERRED: albedo, position and normal
+// GBUFFER_COMPACT: albedo and octahedral normal, the position is reconstructed from depth
+#include "gbuffer.glsl"
+layout(location = 3) out vec4 depColor;
+
+void main()
+{
+	vec3 norm = normalize(vNormal);
+
+	vec3 albedo = texture(uTexture, vTexCoord).rgb;
+
+	// The deferred layouts are lit by the deferred pass
+#if defined(GBUFFER_COMPACT)
+	oColor = vec4(albedo, 1.0);
+	posColor = vec4(EncodeOctahedral(norm), 0.0, 0.0);
+#else
+#if defined(DEFERRED)
+	oColor = vec4(albedo, 1.0);
+#else
+	oColor = vec4(ComputeLighting(vPosition, norm) * albedo, 1.0);
+#endif
+	posColor = vec4(vPosition, 1.0);
+	norColor = vec4(norm, 1.0);
+#endif
+}
+
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#ifdef TEXTURED_GEOMETRY_INSTANCED
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+#include "lights.glsl"
+
+struct Instance
 {
-	unsigned int type;
-	vec3 color;
-	vec3 direction;
-	vec3 position;
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
 };
 
-layout(binding = 0, std140) uniform GlobalParams
+// One entry per instance of the batch being drawn
+layout(binding = 1, std430) readonly buffer InstanceParams
 {
-	vec3 uCameraPosition;
-	unsigned int uLightCount;
-	Light uLight[16];
+	Instance uInstances[];
 };
 
-// TODO: Write your fragment shader here
+out vec2 vTexCoord;
+out vec3 vPosition; // In worldSpace
+out vec3 vNormal; // In worldSpace
+out vec3 vViewDir;
+
+void main()
+{
+	mat4 worldMatrix = uInstances[gl_InstanceID].worldMatrix;
+
+	vTexCoord = aTexCoord;
+	vPosition = vec3(worldMatrix * vec4(aPosition, 1.0));
+	vNormal = vec3(worldMatrix * vec4(aNormal, 0.0));
+	vViewDir = uCameraPosition - vPosition;
+	gl_Position = uInstances[gl_InstanceID].worldViewProjectionMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "lights.glsl"
+
 in vec2 vTexCoord;
 in vec3 vPosition;
 in vec3 vNormal;
@@ -87,38 +148,181 @@ uniform sampler2D uTexture;
 layout(location = 0) out vec4 oColor;
 layout(location = 1) out vec4 posColor;
 layout(location = 2) out vec4 norColor;
-layout(location = 3) out vec4 depColor;
+
+// Forward: lit color, position and normal
+// DEFERRED: albedo, position and normal
+// GBUFFER_COMPACT: albedo and octahedral normal, the position is reconstructed from depth
+#include "gbuffer.glsl"
+
+void main()
+{
+	vec3 norm = normalize(vNormal);
+
+	vec3 albedo = texture(uTexture, vTexCoord).rgb;
+
+	// The deferred layouts are lit by the deferred pass
+#if defined(GBUFFER_COMPACT)
+	oColor = vec4(albedo, 1.0);
+	posColor = vec4(EncodeOctahedral(norm), 0.0, 0.0);
+#else
+#if defined(DEFERRED)
+	oColor = vec4(albedo, 1.0);
+#else
+	oColor = vec4(ComputeLighting(vPosition, norm) * albedo, 1.0);
+#endif
+	posColor = vec4(vPosition, 1.0);
+	norColor = vec4(norm, 1.0);
+#endif
+}
+
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+#if defined(TEXTURED_GEOMETRY_INDIRECT) || defined(TEXTURED_GEOMETRY_INDIRECT_BINDLESS)
+
+// The bindless variant samples the arrays through the handles of the texture table
+// instead of the array bound to unit 0
+#ifdef TEXTURED_GEOMETRY_INDIRECT_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+layout(location = 5) in uint aDrawId; // Index of the multi-draw command
+
+#include "lights.glsl"
+
+struct Instance
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+// Every instance of the frame, grouped by model
+layout(binding = 1, std430) readonly buffer InstanceParams
+{
+	Instance uInstances[];
+};
+
+struct Draw
+{
+	uint firstInstance;
+	uint materialIdx;
+};
+
+// One entry per multi-draw command
+layout(binding = 2, std430) readonly buffer DrawParams
+{
+	Draw uDraws[];
+};
+
+out vec2 vTexCoord;
+out vec3 vPosition; // In worldSpace
+out vec3 vNormal; // In worldSpace
+out vec3 vViewDir;
+flat out uint vMaterialIdx;
 
 void main()
 {
-	vec3 result = vec3(0.0);
+	Draw draw = uDraws[aDrawId];
+	Instance instance = uInstances[draw.firstInstance + gl_InstanceID];
 
+	vTexCoord = aTexCoord;
+	vPosition = vec3(instance.worldMatrix * vec4(aPosition, 1.0));
+	vNormal = vec3(instance.worldMatrix * vec4(aNormal, 0.0));
+	vViewDir = uCameraPosition - vPosition;
+	vMaterialIdx = draw.materialIdx;
+	gl_Position = instance.worldViewProjectionMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "lights.glsl"
+
+in vec2 vTexCoord;
+in vec3 vPosition;
+in vec3 vNormal;
+in vec3 vViewDir;
+flat in uint vMaterialIdx;
+
+struct Material
+{
+	vec3 albedo;
+	float smoothness;
+	vec3 emissive;
+	uint albedoTextureIdx;
+	uint emissiveTextureIdx;
+	uint specularTextureIdx;
+	uint normalsTextureIdx;
+	uint bumpTextureIdx;
+};
+
+// Every material, indexed by the draw
+layout(binding = 4, std430) readonly buffer MaterialTable
+{
+	Material uMaterials[];
+};
+
+struct TextureSlot
+{
+	uint layer;
+	float minLevel; // the larger levels aren't streamed in yet
+	uvec2 arrayHandle;
+};
+
+// One entry per texture
+layout(binding = 3, std430) readonly buffer TextureTable
+{
+	TextureSlot uTextures[];
+};
+
+#ifndef TEXTURED_GEOMETRY_INDIRECT_BINDLESS
+uniform sampler2DArray uTextureArray;
+#endif
+
+layout(location = 0) out vec4 oColor;
+layout(location = 1) out vec4 posColor;
+layout(location = 2) out vec4 norColor;
+
+// Forward: lit color, position and normal
+// DEFERRED: albedo, position and normal
+// GBUFFER_COMPACT: albedo and octahedral normal, the position is reconstructed from depth
+#include "gbuffer.glsl"
+
+void main()
+{
 	vec3 norm = normalize(vNormal);
 
-	for(int i = 0; i < uLightCount; i++)
-	{
-		if(uLight[i].type == 0)
-		{
-			float diff = max(dot(norm, uLight[i].direction), 0.0);
-			vec3 diffuse = diff * uLight[i].color;
-			result += diffuse;
-		}
-		if(uLight[i].type == 1)
-		{
-			vec3 lightDir = normalize(uLight[i].position - vPosition);
-			float diff = max(dot(norm, lightDir), 0.0);
-			vec3 diffuse = diff * uLight[i].color;
-			float distance = length(uLight[i].position - vPosition);
-			float attenuation = 1.0 / (distance * distance);
-			attenuation *= 2;
-			diffuse *= attenuation;
-			result += diffuse;
-		}
-	}
-
-	oColor = vec4(result * texture(uTexture, vTexCoord).rgb, 1.0);
+	Material material = uMaterials[vMaterialIdx];
+	TextureSlot slot = uTextures[material.albedoTextureIdx];
+#ifdef TEXTURED_GEOMETRY_INDIRECT_BINDLESS
+	sampler2DArray textureArray = sampler2DArray(slot.arrayHandle);
+#else
+	#define textureArray uTextureArray
+#endif
+	float lod = max(textureQueryLod(textureArray, vTexCoord).y, slot.minLevel);
+	vec3 albedo = textureLod(textureArray, vec3(vTexCoord, float(slot.layer)), lod).rgb;
+
+	// The deferred layouts are lit by the deferred pass
+#if defined(GBUFFER_COMPACT)
+	oColor = vec4(albedo, 1.0);
+	posColor = vec4(EncodeOctahedral(norm), 0.0, 0.0);
+#else
+#if defined(DEFERRED)
+	oColor = vec4(albedo, 1.0);
+#else
+	oColor = vec4(ComputeLighting(vPosition, norm) * albedo + material.emissive, 1.0);
+#endif
 	posColor = vec4(vPosition, 1.0);
 	norColor = vec4(norm, 1.0);
+#endif
 }
 
 #endif
@@ -128,4 +332,6 @@ void main()
 // NOTE: You can write several shaders in the same file if you want as
 // long as you embrace them within an #ifdef block (as you can see above).
 // The third parameter of the LoadProgram function in engine.cpp allows
-// chosing the shader you want to load by name.
+// chosing the shader you want to load by name, the fourth one takes the
+// keywords of the permutation (e.g. "GBUFFER_COMPACT LIGHT_COUNT=4").
+// Shared code goes in files pulled in with #include "file".
@@ -19,19 +19,163 @@ void main()
 
 #elif defined(FRAGMENT) /////////////////////////////////////////////// 
 
-struct Light
+#include "lights.glsl"
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+layout(location = 0) uniform sampler2D colColor;
+layout(location = 1) uniform sampler2D posColor;
+layout(location = 2) uniform sampler2D norColor;
+
+#include "gbuffer.glsl"
+
+void main()
+{
+	vec3 position = ReadGBufferPosition(posColor, vTexCoord);
+	vec3 norm = ReadGBufferNormal(norColor, vTexCoord);
+
+	vec3 result = ComputeLighting(position, norm);
+
+	oColor = vec4(result * texture(colColor, vTexCoord).rgb, 1.0);
+}
+
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////
+// Assigns the point lights to the froxels of the view frustum. One work
+// group per cluster
+///////////////////////////////////////////////////////////////////////
+#ifdef CLUSTER_LIGHTS
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+layout(local_size_x = 64) in;
+
+#include "clusterlights.glsl"
+
+layout(binding = 4, std430) writeonly buffer ClusterGrid
 {
-	unsigned int type;
-	vec3 color;
-	vec3 direction;
-	vec3 position;
+	uvec2 uClusters[]; // offset and count in uLightIndices
 };
 
-layout(binding = 0, std140) uniform GlobalParams
+layout(binding = 5, std430) buffer ClusterLightIndices
 {
-	vec3 uCameraPosition;
-	unsigned int uLightCount;
-	Light uLight[16];
+	uint uIndexCount;
+	uint uLightIndices[];
+};
+
+layout(location = 0) uniform mat4 uInverseProjection;
+layout(location = 1) uniform mat4 uView;
+layout(location = 2) uniform float uNear;
+layout(location = 3) uniform float uFar;
+layout(location = 4) uniform uint uMaxLightIndices;
+
+shared uint sLights[MAX_LIGHTS_PER_CLUSTER];
+shared uint sLightCount;
+shared uint sOffset;
+shared vec3 sMin;
+shared vec3 sMax;
+
+// Point of the view ray through ndc at the given view space depth
+vec3 NdcToView(vec2 ndc, float viewDepth)
+{
+	vec4 p = uInverseProjection * vec4(ndc, -1.0, 1.0);
+	p.xyz /= p.w;
+	return p.xyz * (viewDepth / -p.z);
+}
+
+void main()
+{
+	uvec3 cluster = gl_WorkGroupID;
+	uint clusterIdx = cluster.x + cluster.y * CLUSTER_GRID_X + cluster.z * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		vec2 ndcMin = vec2(cluster.xy) / vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y) * 2.0 - 1.0;
+		vec2 ndcMax = vec2(cluster.xy + 1u) / vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y) * 2.0 - 1.0;
+		float depthNear = uNear * pow(uFar / uNear, float(cluster.z) / CLUSTER_GRID_Z);
+		float depthFar = uNear * pow(uFar / uNear, float(cluster.z + 1u) / CLUSTER_GRID_Z);
+
+		vec3 a = NdcToView(ndcMin, depthNear);
+		vec3 b = NdcToView(ndcMax, depthNear);
+		vec3 c = NdcToView(ndcMin, depthFar);
+		vec3 d = NdcToView(ndcMax, depthFar);
+		sMin = min(min(a, b), min(c, d));
+		sMax = max(max(a, b), max(c, d));
+		sLightCount = 0;
+	}
+	barrier();
+
+	for (uint i = uDirectionalLightCount + gl_LocalInvocationIndex; i < uLightCount; i += gl_WorkGroupSize.x)
+	{
+		vec3 center = (uView * vec4(uLights[i].position, 1.0)).xyz;
+		vec3 closest = clamp(center, sMin, sMax);
+		vec3 d = closest - center;
+		if (dot(d, d) <= uLights[i].radius * uLights[i].radius)
+		{
+			uint slot = atomicAdd(sLightCount, 1u);
+			if (slot < MAX_LIGHTS_PER_CLUSTER)
+				sLights[slot] = i;
+		}
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0)
+	{
+		uint count = min(sLightCount, uint(MAX_LIGHTS_PER_CLUSTER));
+		uint offset = atomicAdd(uIndexCount, count);
+		count = offset < uMaxLightIndices ? min(count, uMaxLightIndices - offset) : 0;
+		uClusters[clusterIdx] = uvec2(offset, count);
+		sOffset = offset;
+		sLightCount = count;
+	}
+	barrier();
+
+	for (uint i = gl_LocalInvocationIndex; i < sLightCount; i += gl_WorkGroupSize.x)
+		uLightIndices[sOffset + i] = sLights[i];
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Deferred lighting that only evaluates the point lights of the pixel
+// cluster, directional lights are evaluated everywhere
+///////////////////////////////////////////////////////////////////////
+#ifdef CLUSTERED_LIGHTING
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	vTexCoord = aTexCoord;
+	gl_Position = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "clusterlights.glsl"
+
+layout(binding = 4, std430) readonly buffer ClusterGrid
+{
+	uvec2 uClusters[];
+};
+
+layout(binding = 5, std430) readonly buffer ClusterLightIndices
+{
+	uint uIndexCount;
+	uint uLightIndices[];
 };
 
 in vec2 vTexCoord;
@@ -41,43 +185,153 @@ layout(location = 0) out vec4 oColor;
 layout(location = 0) uniform sampler2D colColor;
 layout(location = 1) uniform sampler2D posColor;
 layout(location = 2) uniform sampler2D norColor;
+layout(location = 3) uniform mat4 uView;
+layout(location = 4) uniform vec2 uScreenSize;
+layout(location = 5) uniform float uNear;
+layout(location = 6) uniform float uFar;
+
+#include "gbuffer.glsl"
+
+void main()
+{
+	vec3 position = ReadGBufferPosition(posColor, vTexCoord);
+	vec3 norm = ReadGBufferNormal(norColor, vTexCoord);
+
+	vec3 result = vec3(0.0);
+
+	for(uint i = 0; i < uDirectionalLightCount; i++)
+	{
+		float diff = max(dot(norm, uLights[i].direction), 0.0);
+		result += diff * uLights[i].color;
+	}
+
+	float viewDepth = max(-(uView * vec4(position, 1.0)).z, uNear);
+	uint slice = uint(clamp(log(viewDepth / uNear) / log(uFar / uNear) * CLUSTER_GRID_Z, 0.0, CLUSTER_GRID_Z - 1));
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / uScreenSize * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	uvec2 cluster = uClusters[tile.x + tile.y * CLUSTER_GRID_X + slice * CLUSTER_GRID_X * CLUSTER_GRID_Y];
+
+	for(uint i = 0; i < cluster.y; i++)
+	{
+		Light light = uLights[uLightIndices[cluster.x + i]];
+		vec3 lightDir = normalize(light.position - position);
+		float diff = max(dot(norm, lightDir), 0.0);
+		vec3 diffuse = diff * light.color;
+		float distance = length(light.position - position);
+		float attenuation = 1.0 / (distance * distance);
+		attenuation *= 2;
+		diffuse *= attenuation;
+		result += diffuse;
+	}
+
+	oColor = vec4(result * texture(colColor, vTexCoord).rgb, 1.0);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Light volumes: directional lights are applied with a full screen quad
+// and every point light adds its contribution inside its range sphere
+///////////////////////////////////////////////////////////////////////
+#ifdef DIRECTIONAL_LIGHTING
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+out vec2 vTexCoord;
+
+void main()
+{
+	vTexCoord = aTexCoord;
+	gl_Position = vec4(aPosition.x, aPosition.y, 0.0, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "lights.glsl"
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+layout(location = 0) uniform sampler2D colColor;
+layout(location = 2) uniform sampler2D norColor;
+
+#include "gbuffer.glsl"
 
 void main()
 {
-	vec3 position = texture(posColor, vTexCoord).rgb;
-	vec3 norm = texture(norColor, vTexCoord).rgb;
+	vec3 norm = ReadGBufferNormal(norColor, vTexCoord);
 
 	vec3 result = vec3(0.0);
 
-	for(int i = 0; i < uLightCount; i++)
+	for(int i = 0; i < GLOBAL_LIGHT_COUNT; i++)
 	{
 		if(uLight[i].type == 0)
 		{
 			float diff = max(dot(norm, uLight[i].direction), 0.0);
-			vec3 diffuse = diff * uLight[i].color;
-			result += diffuse;
-		}
-		if(uLight[i].type == 1)
-		{
-			vec3 lightDir = normalize(uLight[i].position - position);
-			float diff = max(dot(norm, lightDir), 0.0);
-			vec3 diffuse = diff * uLight[i].color;
-			float distance = length(uLight[i].position - position);
-			float attenuation = 1.0 / (distance * distance);
-			attenuation *= 2;
-			diffuse *= attenuation;
-			result += diffuse;
+			result += diff * uLight[i].color;
 		}
 	}
 
-	oColor = vec4(result * texture(colColor, vTexCoord).rgb, 1.0);;
+	oColor = vec4(result * texture(colColor, vTexCoord).rgb, 1.0);
 }
 
 #endif
 #endif
 
+#ifdef LIGHT_VOLUME
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+
+uniform mat4 uWorldViewProjection;
+
+void main()
+{
+	gl_Position = uWorldViewProjection * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+layout(location = 0) out vec4 oColor;
+
+layout(location = 0) uniform sampler2D colColor;
+layout(location = 1) uniform sampler2D posColor;
+layout(location = 2) uniform sampler2D norColor;
+
+uniform vec2 uScreenSize;
+uniform vec3 uLightPosition;
+uniform vec3 uLightColor;
+
+#include "gbuffer.glsl"
+
+void main()
+{
+	vec2 texCoord = gl_FragCoord.xy / uScreenSize;
+	vec3 position = ReadGBufferPosition(posColor, texCoord);
+	vec3 norm = ReadGBufferNormal(norColor, texCoord);
+
+	vec3 lightDir = normalize(uLightPosition - position);
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuse = diff * uLightColor;
+	float distance = length(uLightPosition - position);
+	float attenuation = 1.0 / (distance * distance);
+	attenuation *= 2;
+	diffuse *= attenuation;
+
+	oColor = vec4(diffuse * texture(colColor, texCoord).rgb, 1.0);
+}
+
+#endif
+#endif
 
 // NOTE: You can write several shaders in the same file if you want as
 // long as you embrace them within an #ifdef block (as you can see above).
 // The third parameter of the LoadProgram function in engine.cpp allows
-// chosing the shader you want to load by name.
+// chosing the shader you want to load by name, the fourth one takes the
+// keywords of the permutation (e.g. "GBUFFER_COMPACT LIGHT_COUNT=4").
+// Shared code goes in files pulled in with #include "file".